@@ -0,0 +1,13 @@
+#include "benchmarks/benchmark.h"
+#include "core/types.h"
+#include "core/expression.h"
+#include "core/evaluate.h"
+
+int main(int argc, char **argv) {
+	Heap::init();
+	EvaluateDispatch::init();
+
+	// an optional argument restricts the run to benchmarks containing that string.
+	Benchmark::run_all(argc > 1 ? argv[1] : nullptr);
+	return 0;
+}
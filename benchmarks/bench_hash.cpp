@@ -0,0 +1,87 @@
+#include <unordered_set>
+
+#include "benchmarks/benchmark.h"
+#include "core/types.h"
+#include "core/integer.h"
+#include "core/real.h"
+#include "core/rational.h"
+#include "core/expression.h"
+#include "core/vectorized.h"
+
+// bucket quality of the atom hashes, compared against the hashes they replaced, and the
+// throughput of hashing packed lists.
+
+namespace {
+	inline hash_t previous_machine_integer_hash(machine_integer_t x) {
+		return hash_pair(machine_integer_hash, x);
+	}
+
+	inline hash_t previous_machine_real_hash(machine_real_t x) {
+		// truncated to an integer, so all values in [k, k + 1) collided.
+		return hash_pair(machine_real_hash, (uint64_t)x);
+	}
+
+	template<typename F>
+	void report_buckets(const char *what, size_t n, const F &f) {
+		// keys go into a power-of-two table of n buckets, as in open addressing.
+		std::unordered_set<hash_t> hashes;
+		std::vector<bool> used(n);
+		size_t buckets = 0;
+		for (size_t i = 0; i < n; i++) {
+			const hash_t h = f(i);
+			hashes.insert(h);
+			if (!used[h & (n - 1)]) {
+				used[h & (n - 1)] = true;
+				buckets++;
+			}
+		}
+		std::cout << "    " << what << ": " << hashes.size() << " distinct hashes, " <<
+			buckets << " of " << n << " buckets used" << std::endl;
+	}
+}
+
+BENCHMARK(hash_buckets) {
+	const size_t n = 1 << 20;
+
+	report_buckets("previous, consecutive integers", n, [] (size_t i) {
+		return previous_machine_integer_hash(machine_integer_t(i));
+	});
+	report_buckets("current, consecutive integers", n, [] (size_t i) {
+		return MachineInteger(machine_integer_t(i)).hash();
+	});
+	report_buckets("previous, reals i / 4", n, [] (size_t i) {
+		return previous_machine_real_hash(i * 0.25);
+	});
+	report_buckets("current, reals i / 4", n, [] (size_t i) {
+		return MachineReal(i * 0.25).hash();
+	});
+	report_buckets("current, rationals i / 7", n, [] (size_t i) {
+		return Rational(mpq_class(machine_integer_t(i), 7) + mpq_class(0)).hash();
+	});
+}
+
+BENCHMARK(hash_packed) {
+	const size_t n = 8000000;
+	const size_t rounds = 20;
+
+	std::vector<machine_integer_t> values(n);
+	for (size_t i = 0; i < n; i++) {
+		values[i] = machine_integer_t(i);
+	}
+
+	volatile hash_t sink;
+	report("hash_leaf", measure([&values, &sink, n, rounds] () {
+		for (size_t r = 0; r < rounds; r++) {
+			hash_t h = 0;
+			for (size_t i = 0; i < n; i++) {
+				h = hash_leaf(h, hash_machine_integer(values[i]));
+			}
+			sink = h;
+		}
+	}), n * rounds);
+	report("hash_machine_integers", measure([&values, &sink, n, rounds] () {
+		for (size_t r = 0; r < rounds; r++) {
+			sink = hash_machine_integers(values.data(), n);
+		}
+	}), n * rounds);
+}
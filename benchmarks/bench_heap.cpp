@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <random>
+#include <boost/pool/object_pool.hpp>
+
+#include "benchmarks/benchmark.h"
+#include "core/types.h"
+#include "core/integer.h"
+#include "core/expression.h"
+
+// compares SlabPool against boost::object_pool (which Heap used before) and plain new/delete
+// for the typical Heap workload: lots of short-lived MachineIntegers, freed in random order.
+
+template<typename Pool>
+static double churn(Pool &pool, size_t n, size_t rounds) {
+	std::vector<MachineInteger*> objects(n);
+	std::mt19937 random(42);
+
+	return measure([&pool, &objects, &random, n, rounds] () {
+		for (size_t r = 0; r < rounds; r++) {
+			for (size_t i = 0; i < n; i++) {
+				objects[i] = pool.construct(machine_integer_t(i));
+			}
+			std::shuffle(objects.begin(), objects.end(), random);
+			for (size_t i = 0; i < n; i++) {
+				pool.destroy(objects[i]);
+			}
+		}
+	});
+}
+
+class SlabPoolAdapter {
+private:
+	ObjectPool<MachineInteger> _pool;
+
+public:
+	inline MachineInteger *construct(machine_integer_t value) {
+		return _pool.construct(value);
+	}
+
+	inline void destroy(MachineInteger *p) {
+		_pool.free(p);
+	}
+};
+
+class BoostPoolAdapter {
+private:
+	boost::object_pool<MachineInteger> _pool;
+
+public:
+	inline MachineInteger *construct(machine_integer_t value) {
+		return _pool.construct(value);
+	}
+
+	inline void destroy(MachineInteger *p) {
+		_pool.free(p);
+	}
+};
+
+class NewDeleteAdapter {
+public:
+	inline MachineInteger *construct(machine_integer_t value) {
+		return new MachineInteger(value);
+	}
+
+	inline void destroy(MachineInteger *p) {
+		delete p;
+	}
+};
+
+BENCHMARK(heap_churn) {
+	// boost::object_pool::free is linear in the pool size, so we keep n moderate here in
+	// order to have the comparison finish at all; the gap widens with larger n.
+	for (size_t n : {1000, 4000, 16000}) {
+		const size_t rounds = 200000 / n;
+		const size_t ops = 2 * n * rounds;
+
+		std::cout << "  n = " << n << std::endl;
+		{
+			SlabPoolAdapter pool;
+			report("SlabPool", churn(pool, n, rounds), ops);
+		}
+		{
+			BoostPoolAdapter pool;
+			report("boost::object_pool", churn(pool, n, rounds), ops);
+		}
+		{
+			NewDeleteAdapter pool;
+			report("new/delete", churn(pool, n, rounds), ops);
+		}
+	}
+}
+
+BENCHMARK(heap_churn_large) {
+	const size_t n = 1000000;
+	const size_t rounds = 5;
+	const size_t ops = 2 * n * rounds;
+
+	std::cout << "  n = " << n << std::endl;
+	{
+		SlabPoolAdapter pool;
+		report("SlabPool", churn(pool, n, rounds), ops);
+	}
+	{
+		NewDeleteAdapter pool;
+		report("new/delete", churn(pool, n, rounds), ops);
+	}
+}
+
+BENCHMARK(heap_packed) {
+	// building and dropping small packed lists, e.g. Range[4] evaluated in a loop.
+	const size_t n = 1000000;
+	const BaseExpressionRef head = from_primitive(std::string("List"));
+
+	const auto build = [&head, n] () {
+		for (size_t i = 0; i < n; i++) {
+			std::vector<machine_integer_t> values{1, 2, 3, 4};
+			expression(head, PackSlice<machine_integer_t>(std::move(values)));
+		}
+	};
+
+	report("pooled", measure(build), n);
+	{
+		const ArenaScope arena;
+		report("arena", measure(build), n);
+	}
+}
+
+BENCHMARK(heap_refs) {
+	// building and dropping expressions with a handful of (shared) leaves.
+	const size_t n = 1000000;
+	const BaseExpressionRef head = from_primitive(std::string("f"));
+	const BaseExpressionRef leaf = from_primitive(std::string("x"));
+
+	const auto build = [&head, &leaf, n] () {
+		for (size_t i = 0; i < n; i++) {
+			std::vector<BaseExpressionRef> leaves(10, leaf);
+			expression(head, std::move(leaves));
+		}
+	};
+
+	report("pooled", measure(build), n);
+	{
+		const ArenaScope arena;
+		report("arena", measure(build), n);
+	}
+}
+
+BENCHMARK(heap_immediates) {
+	// boxing small integers, e.g. when iterating the leaves of a packed Range[1000].
+	const size_t n = 1000;
+	const size_t rounds = 10000;
+	const size_t ops = n * rounds;
+
+	machine_integer_t sum = 0;
+
+	report("immediate", measure([&sum, n, rounds] () {
+		for (size_t r = 0; r < rounds; r++) {
+			for (size_t i = 1; i <= n; i++) {
+				const BaseExpressionRef boxed = from_primitive(machine_integer_t(i));
+				sum += static_cast<const MachineInteger*>(boxed.get())->value;
+			}
+		}
+	}), ops);
+
+	report("allocated", measure([&sum, n, rounds] () {
+		for (size_t r = 0; r < rounds; r++) {
+			for (size_t i = 1; i <= n; i++) {
+				const BaseExpressionRef boxed = Heap::MachineInteger(machine_integer_t(i));
+				sum += static_cast<const MachineInteger*>(boxed.get())->value;
+			}
+		}
+	}), ops);
+
+	std::cout << "  (checksum " << sum << ")" << std::endl;
+}
+
+BENCHMARK(heap_interning) {
+	// repetitive symbolic data: n copies of f[x, g[x, 2^40]], built leaf by leaf as a parser would.
+	const size_t n = 200000;
+	const BaseExpressionRef f = from_primitive(std::string("f"));
+	const BaseExpressionRef g = from_primitive(std::string("g"));
+
+	for (const bool interning : {false, true}) {
+		Interning scope(interning);
+		std::vector<BaseExpressionRef> items;
+		items.reserve(n);
+
+		const size_t before = Heap::memory_in_use();
+		const double ms = measure([&items, &f, &g, n] () {
+			for (size_t i = 0; i < n; i++) {
+				const BaseExpressionRef x = from_primitive(std::string("x"));
+				const BaseExpressionRef inner = expression(g, std::vector<BaseExpressionRef>{
+					x, Heap::MachineInteger(machine_integer_t(1) << 40)});
+				items.push_back(expression(f, std::vector<BaseExpressionRef>{x, inner}));
+			}
+		});
+
+		report(interning ? "interning" : "plain", ms, n);
+		std::cout << "    " << (Heap::memory_in_use() - before) / 1024 << " KiB in use" << std::endl;
+	}
+}
@@ -0,0 +1,83 @@
+#include <random>
+
+#include "benchmarks/benchmark.h"
+#include "core/types.h"
+#include "core/integer.h"
+#include "core/expression.h"
+#include "core/vectorized.h"
+
+// totals over large packed lists, compared against the element-wise loops Plus used before.
+
+BENCHMARK(vectorized_sum_reals) {
+	const size_t n = 8000000;
+	const size_t rounds = 20;
+
+	std::vector<machine_real_t> values(n);
+	std::mt19937 random(42);
+	std::uniform_real_distribution<machine_real_t> distribution(-1., 1.);
+	for (size_t i = 0; i < n; i++) {
+		values[i] = distribution(random);
+	}
+
+	volatile machine_real_t sink;
+	report("sequential", measure([&values, &sink, n, rounds] () {
+		for (size_t r = 0; r < rounds; r++) {
+			machine_real_t sum = 0.;
+			for (size_t i = 0; i < n; i++) {
+				sum += values[i];
+			}
+			sink = sum;
+		}
+	}), n * rounds);
+	report("sum_machine_reals", measure([&values, &sink, n, rounds] () {
+		for (size_t r = 0; r < rounds; r++) {
+			sink = sum_machine_reals(values.data(), n);
+		}
+	}), n * rounds);
+}
+
+BENCHMARK(vectorized_sum_integers) {
+	const size_t n = 8000000;
+	const size_t rounds = 20;
+
+	std::vector<machine_integer_t> values(n);
+	std::mt19937_64 random(42);
+	for (size_t i = 0; i < n; i++) {
+		values[i] = static_cast<machine_integer_t>(random());
+	}
+
+	volatile machine_integer_t sink;
+	report("mpint", measure([&values, &sink, n, rounds] () {
+		for (size_t r = 0; r < rounds; r++) {
+			mpint sum(0);
+			for (size_t i = 0; i < n; i++) {
+				sum += mpint(values[i]);
+			}
+			sink = sum.is_big;
+		}
+	}), n * rounds);
+	report("sum_machine_integers", measure([&values, &sink, n, rounds] () {
+		for (size_t r = 0; r < rounds; r++) {
+			sink = static_cast<machine_integer_t>(sum_machine_integers(values.data(), n));
+		}
+	}), n * rounds);
+}
+
+BENCHMARK(vectorized_plus) {
+	// Plus over a packed list, i.e. Total[Range[n]].
+	const size_t n = 8000000;
+	const size_t rounds = 20;
+
+	std::vector<machine_integer_t> values(n);
+	for (size_t i = 0; i < n; i++) {
+		values[i] = machine_integer_t(i);
+	}
+	const BaseExpressionRef head = from_primitive(std::string("Plus"));
+	const ExpressionRef list = expression(head, PackSlice<machine_integer_t>(std::move(values)));
+
+	report("add_only_integers", measure([&list, rounds] () {
+		for (size_t r = 0; r < rounds; r++) {
+			list->add_only_integers();
+		}
+	}), n * rounds);
+}
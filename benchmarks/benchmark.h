@@ -0,0 +1,58 @@
+#ifndef CMATHICS_BENCHMARK_H
+#define CMATHICS_BENCHMARK_H
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// a minimal benchmark registry. each benchmark reports its own timings through report().
+
+class Benchmark {
+private:
+	static std::vector<Benchmark*> &all() {
+		static std::vector<Benchmark*> benchmarks;
+		return benchmarks;
+	}
+
+public:
+	const char * const name;
+	const std::function<void()> run;
+
+	inline Benchmark(const char *new_name, const std::function<void()> &f) : name(new_name), run(f) {
+		all().push_back(this);
+	}
+
+	static void run_all(const char *filter) {
+		for (const Benchmark *benchmark : all()) {
+			if (filter && std::string(benchmark->name).find(filter) == std::string::npos) {
+				continue;
+			}
+			std::cout << benchmark->name << std::endl;
+			benchmark->run();
+		}
+	}
+};
+
+template<typename F>
+double measure(const F &f) {
+	// returns the time taken to run f in milliseconds.
+	const auto start_time = std::chrono::steady_clock::now();
+	f();
+	const auto end_time = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(end_time - start_time).count();
+}
+
+inline void report(const char *what, double ms, size_t n) {
+	std::cout << "    " << what << ": " << ms << " ms (" << (ms * 1e6 / n) << " ns per op)" << std::endl;
+}
+
+#define BENCHMARK_CONCAT2(a, b) a ## b
+#define BENCHMARK_CONCAT(a, b) BENCHMARK_CONCAT2(a, b)
+
+#define BENCHMARK(name) static void BENCHMARK_CONCAT(benchmark_, name)(); \
+	static Benchmark BENCHMARK_CONCAT(benchmark_instance_, name)(#name, BENCHMARK_CONCAT(benchmark_, name)); \
+	static void BENCHMARK_CONCAT(benchmark_, name)()
+
+#endif //CMATHICS_BENCHMARK_H
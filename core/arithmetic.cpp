@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <assert.h>
 #include <vector>
+#include <cmath>
 
 #include "types.h"
 #include "pattern.h"
@@ -17,7 +18,7 @@ BaseExpressionRef Plus(const ExpressionRef &expr, const Evaluation &evaluation)
     switch (expr->size()) {
         case 0:
             // Plus[] -> 0
-            return from_primitive(0LL);
+            return from_primitive(machine_integer_t(0));
 
         case 1:
             // Plus[a_] -> a
@@ -34,15 +35,26 @@ BaseExpressionRef Plus(const ExpressionRef &expr, const Evaluation &evaluation)
 		return expr->add_only_machine_reals();
 	}
 
+	// expression is all MachineComplexes
+	if (types_seen == MakeTypeMask(MachineComplexType)) {
+		return expr->add_only_machine_complexes();
+	}
+
 	// expression is all Integers
 	if ((types_seen & int_mask) == types_seen) {
 		return expr->add_only_integers();
 	}
 
-	// expression contains a Real
-    if (types_seen & MakeTypeMask(MachineRealType)) {
-        return expr->add_machine_inexact();
-    }
+	// expression is all Integers and Rationals
+	if ((types_seen & (int_mask | MakeTypeMask(RationalType))) == types_seen) {
+		return expr->add_only_rationals();
+	}
+
+	// expression contains a Real or a Complex
+	constexpr TypeMask machine_inexact_mask = MakeTypeMask(MachineRealType) | MakeTypeMask(MachineComplexType);
+	if (types_seen & machine_inexact_mask) {
+		return expr->add_machine_inexact();
+	}
 
     // expression contains an Integer
     /*if (types_seen & int_mask) {
@@ -51,7 +63,7 @@ BaseExpressionRef Plus(const ExpressionRef &expr, const Evaluation &evaluation)
         return integer_result;
     }*/
 
-    // TODO rational and complex
+    // TODO BigReals and BigComplexes only
 
     // expression is symbolic
     return BaseExpressionRef();
@@ -106,12 +118,77 @@ public:
 		const T imax = to_primitive<T>(_imax);
 		const T di = to_primitive<T>(_di);
 
-		std::vector<T> leaves;
-		for (T x = imin; x <= imax; x += di) {
-			leaves.push_back(x);
+		if (di == 0) {
+			return BaseExpressionRef(); // cannot evaluate
+		}
+
+		const size_t n = range_size(imin, imax, di);
+		if (n == 0) {
+			return _evaluation.definitions.empty_list();
+		}
+
+		return range(imin, di, n);
+	}
+
+private:
+	// the number of elements imin, imin + di, ... that lie between imin and imax.
+	static size_t range_size(machine_integer_t imin, machine_integer_t imax, machine_integer_t di) {
+		const __int128 steps = (__int128(imax) - __int128(imin)) / __int128(di);
+		if (steps < 0) {
+			return 0;
+		} else if (steps >= __int128(std::numeric_limits<machine_integer_t>::max())) {
+			throw MemoryLimitExceeded(); // sizes and indices need to fit into index_t
+		}
+		return size_t(steps) + 1;
+	}
+
+	static size_t range_size(machine_real_t imin, machine_real_t imax, machine_real_t di) {
+		const machine_real_t steps = std::floor((imax - imin) / di);
+		if (steps < 0) {
+			return 0;
+		} else if (!(steps < machine_real_t(std::numeric_limits<machine_integer_t>::max()))) {
+			throw MemoryLimitExceeded(); // also for NaN
+		}
+		return size_t(steps) + 1;
+	}
+
+	static size_t range_size(const mpz_class &imin, const mpz_class &imax, const mpz_class &di) {
+		const mpz_class steps((imax - imin) / di);
+		if (steps < 0) {
+			return 0;
+		} else if (!(steps < std::numeric_limits<machine_integer_t>::max())) {
+			throw MemoryLimitExceeded();
+		}
+		return steps.get_ui() + 1;
+	}
+
+	static size_t range_size(const mpq_class &imin, const mpq_class &imax, const mpq_class &di) {
+		const mpq_class quotient((imax - imin) / di);
+		mpz_class steps;
+		mpz_fdiv_q(steps.get_mpz_t(), quotient.get_num_mpz_t(), quotient.get_den_mpz_t());
+		return range_size(mpz_class(0), steps, mpz_class(1));
+	}
+
+	// machine integer progressions are never stored, see RangeSlice.
+	BaseExpressionRef range(machine_integer_t imin, machine_integer_t di, size_t n) const {
+		return expression(_evaluation.definitions.List(), RangeSlice(imin, di, n));
+	}
+
+	template<typename T>
+	BaseExpressionRef range(const T &imin, const T &di, size_t n) const {
+		// the vector is not accounted for by the Heap.
+		if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+			throw MemoryLimitExceeded();
+		}
+		Heap::ensure_available(n * sizeof(T));
+		adaptive_storage leaves(n);
+		T x = imin;
+		for (size_t i = 0; i < n; i++) {
+			leaves << x;
+			x += di;
 		}
 
-		return expression(_evaluation.definitions.List(), PackSlice<T>(std::move(leaves)));
+		return leaves.to_expression(_evaluation.definitions.List());
 	}
 };
 
@@ -17,7 +17,9 @@ BaseExpressionRef Range(
 class ArithmeticOperations {
 public:
 	virtual BaseExpressionRef add_only_integers() const = 0;
+	virtual BaseExpressionRef add_only_rationals() const = 0;
 	virtual BaseExpressionRef add_only_machine_reals() const = 0;
+	virtual BaseExpressionRef add_only_machine_complexes() const = 0;
 	virtual BaseExpressionRef add_machine_inexact() const = 0;
 };
 
@@ -27,7 +29,9 @@ class ArithmeticOperationsImplementation :
 	virtual public OperationsImplementation<T> {
 public:
 	virtual BaseExpressionRef add_only_integers() const;
+	virtual BaseExpressionRef add_only_rationals() const;
 	virtual BaseExpressionRef add_only_machine_reals() const;
+	virtual BaseExpressionRef add_only_machine_complexes() const;
 	virtual BaseExpressionRef add_machine_inexact() const;
 };
 
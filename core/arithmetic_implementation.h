@@ -6,35 +6,146 @@
 #include "real.h"
 #include "rational.h"
 #include "expression.h"
+#include "vectorized.h"
 
-template<typename T>
-BaseExpressionRef ArithmeticOperationsImplementation<T>::add_only_integers() const {
-	// sums an all MachineInteger/BigInteger expression
-
-	const T &self = this->expr();
+template<typename Slice>
+inline BaseExpressionRef add_integers(const Slice &slice) {
 	mpint result(0);
 
-	for (auto value : self.template primitives<mpint>()) {
+	for (auto value : slice.template primitives<mpint>()) {
 		result += value;
 	}
 
 	return from_primitive(result.to_primitive());
 }
 
+inline BaseExpressionRef from_int128(__int128 value) {
+	const machine_integer_t low = static_cast<machine_integer_t>(value);
+	if (low == value) {
+		return from_primitive(low);
+	} else {
+		mpz_class result(static_cast<long>(value >> 64));
+		result <<= 64;
+		result += static_cast<unsigned long>(static_cast<uint64_t>(value));
+		return from_primitive(result);
+	}
+}
+
+inline BaseExpressionRef add_integers(const PackSlice<machine_integer_t> &slice) {
+	return from_int128(sum_machine_integers(slice.data(), slice.size()));
+}
+
+inline BaseExpressionRef add_integers(const RangeSlice &slice) {
+	// n * start + step * n * (n - 1) / 2, which might not fit into a machine integer.
+	const mpz_class n(static_cast<unsigned long>(slice.size()));
+	mpz_class result(static_cast<long>(slice.start()));
+	result *= n;
+	mpz_class triangle(n * (n - 1) / 2);
+	triangle *= static_cast<long>(slice.step());
+	result += triangle;
+	return from_primitive(result);
+}
+
+inline BaseExpressionRef add_integers(const PackSlice<mpz_class> &slice) {
+	// add the packed values directly, without copying each of them into an mpint.
+	mpz_class result(0);
+
+	const mpz_class *values = slice.data();
+	for (size_t i = 0; i < slice.size(); i++) {
+		mpz_add(result.get_mpz_t(), result.get_mpz_t(), values[i].get_mpz_t());
+	}
+
+	return from_primitive(result);
+}
+
+inline BaseExpressionRef from_exact(const mpq_class &value) {
+	if (value.get_den() == 1) {
+		return from_primitive(value.get_num());
+	} else {
+		return from_primitive(value);
+	}
+}
+
+template<typename Slice>
+inline BaseExpressionRef add_rationals(const Slice &slice) {
+	mpq_class result(0);
+
+	for (auto leaf : slice.leaves()) {
+		result += to_primitive<mpq_class>(leaf);
+	}
+
+	return from_exact(result);
+}
+
+inline BaseExpressionRef add_rationals(const PackSlice<mpq_class> &slice) {
+	mpq_class result(0);
+
+	const mpq_class *values = slice.data();
+	for (size_t i = 0; i < slice.size(); i++) {
+		mpq_add(result.get_mpq_t(), result.get_mpq_t(), values[i].get_mpq_t());
+	}
+
+	return from_exact(result);
+}
+
 template<typename T>
-BaseExpressionRef ArithmeticOperationsImplementation<T>::add_only_machine_reals() const {
-	// sums an all MachineReal expression
+BaseExpressionRef ArithmeticOperationsImplementation<T>::add_only_integers() const {
+	// sums an all MachineInteger/BigInteger expression
 
-	const T &self = this->expr();
+	return add_integers(this->expr()._leaves);
+}
+
+template<typename T>
+BaseExpressionRef ArithmeticOperationsImplementation<T>::add_only_rationals() const {
+	// sums an all MachineInteger/BigInteger/Rational expression
+
+	return add_rationals(this->expr()._leaves);
+}
+
+template<typename Slice>
+inline BaseExpressionRef add_machine_reals(const Slice &slice) {
 	machine_real_t result = 0.;
 
-	for (auto value : self.template primitives<machine_real_t>()) {
+	for (auto value : slice.template primitives<machine_real_t>()) {
 		result += value;
 	}
 
 	return from_primitive(result);
 }
 
+inline BaseExpressionRef add_machine_reals(const PackSlice<machine_real_t> &slice) {
+	return from_primitive(sum_machine_reals(slice.data(), slice.size()));
+}
+
+template<typename Slice>
+inline BaseExpressionRef add_machine_complexes(const Slice &slice) {
+	machine_complex_t result = 0.;
+
+	for (auto leaf : slice.leaves()) {
+		result += boost::static_pointer_cast<const MachineComplex>(leaf)->value;
+	}
+
+	return from_primitive(result);
+}
+
+inline BaseExpressionRef add_machine_complexes(const PackSlice<machine_complex_t> &slice) {
+	return from_primitive(sum_machine_complexes(slice.data(), slice.size()));
+}
+
+template<typename T>
+BaseExpressionRef ArithmeticOperationsImplementation<T>::add_only_machine_reals() const {
+	// sums an all MachineReal expression
+
+	return add_machine_reals(this->expr()._leaves);
+}
+
+template<typename T>
+BaseExpressionRef ArithmeticOperationsImplementation<T>::add_only_machine_complexes() const {
+	// sums an all MachineComplex expression
+
+	return add_machine_complexes(this->expr()._leaves);
+}
+
 template<typename T>
 BaseExpressionRef ArithmeticOperationsImplementation<T>::add_machine_inexact() const {
 	const T &self = this->expr();
@@ -44,6 +155,8 @@ BaseExpressionRef ArithmeticOperationsImplementation<T>::add_machine_inexact() c
 	symbolics.reserve(self.size());
 
 	machine_real_t sum = 0.0;
+	machine_real_t imag = 0.0; // only used if is_complex
+	bool is_complex = false;
 	for (auto leaf : self.leaves()) {
 		auto type = leaf->type();
 		switch(type) {
@@ -63,9 +176,20 @@ BaseExpressionRef ArithmeticOperationsImplementation<T>::add_machine_inexact() c
 			case RationalType:
 				sum += boost::static_pointer_cast<const Rational>(leaf)->value.get_d();
 				break;
-			case ComplexType:
-				assert(false);
+			case MachineComplexType: {
+				const machine_complex_t &value = boost::static_pointer_cast<const MachineComplex>(leaf)->value;
+				sum += value.real();
+				imag += value.imag();
+				is_complex = true;
+				break;
+			}
+			case BigComplexType: {
+				const auto value = boost::static_pointer_cast<const BigComplex>(leaf);
+				sum += value->_real.toDouble(MPFR_RNDN);
+				imag += value->_imag.toDouble(MPFR_RNDN);
+				is_complex = true;
 				break;
+			}
 			case ExpressionType:
 			case SymbolType:
 			case StringType:
@@ -87,11 +211,11 @@ BaseExpressionRef ArithmeticOperationsImplementation<T>::add_machine_inexact() c
 		// result = NULL;
 	} else if (!symbolics.empty()) {
 		// at least one symbolic
-		symbolics.push_back(from_primitive(sum));
+		symbolics.push_back(is_complex ? from_primitive(machine_complex_t(sum, imag)) : from_primitive(sum));
 		result = expression(self._head, std::move(symbolics));
 	} else {
 		// no symbolics
-		result = from_primitive(sum);
+		result = is_complex ? from_primitive(machine_complex_t(sum, imag)) : from_primitive(sum);
 	}
 
 	return result;
@@ -0,0 +1,25 @@
+#include "types.h"
+#include "complex.h"
+#include "primitives.h"
+
+BaseExpressionRef complex(const BaseExpressionRef &re, const BaseExpressionRef &im) {
+	constexpr TypeMask machine_mask =
+		MakeTypeMask(MachineIntegerType) | MakeTypeMask(BigIntegerType) | MakeTypeMask(MachineRealType);
+	constexpr TypeMask big_mask = machine_mask | MakeTypeMask(BigRealType);
+
+	const TypeMask mask = re->type_mask() | im->type_mask();
+
+	if ((mask & big_mask) != mask) {
+		return BaseExpressionRef(); // symbolic, rational or complex parts
+	}
+
+	// machine precision wins over arbitrary precision.
+	if (mask & MakeTypeMask(MachineRealType)) {
+		return from_primitive(machine_complex_t(
+			to_primitive<machine_real_t>(re), to_primitive<machine_real_t>(im)));
+	} else if (mask & MakeTypeMask(BigRealType)) {
+		return Heap::BigComplex(to_primitive<mpfr::mpreal>(re), to_primitive<mpfr::mpreal>(im));
+	} else {
+		return BaseExpressionRef(); // TODO exact complex numbers
+	}
+}
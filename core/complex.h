@@ -0,0 +1,81 @@
+#ifndef CMATHICS_COMPLEX_H
+#define CMATHICS_COMPLEX_H
+
+#include <mpfrcxx/mpreal.h>
+#include <sstream>
+
+#include "types.h"
+#include "hash.h"
+#include "real.h"
+
+class MachineComplex : public BaseExpression {
+public:
+    const machine_complex_t value;
+
+    explicit MachineComplex(const machine_complex_t &new_value) :
+        BaseExpression(MachineComplexType), value(new_value) {
+    }
+
+    virtual bool same(const BaseExpression &expr) const {
+        if (expr.type() == MachineComplexType) {
+            return value == static_cast<const MachineComplex*>(&expr)->value;
+        } else {
+            return false;
+        }
+    }
+
+    virtual hash_t hash() const {
+        return hash_machine_complex(value.real(), value.imag());
+    }
+
+    virtual std::string fullform() const {
+        return std::string("Complex[") + std::to_string(value.real()) + ", " +
+            std::to_string(value.imag()) + "]"; // FIXME
+    }
+
+    virtual bool match(const BaseExpression &expr) const {
+        return same(expr);
+    }
+};
+
+class BigComplex : public BaseExpression {
+public:
+    mpfr::mpreal _real;
+    mpfr::mpreal _imag;
+    const double _prec;
+
+    explicit inline BigComplex(const mpfr::mpreal &real, const mpfr::mpreal &imag) :
+        BaseExpression(BigComplexType), _real(real), _imag(imag),
+        _prec(from_bits_prec(std::min(real.get_prec(), imag.get_prec()))) {
+    }
+
+    virtual bool same(const BaseExpression &expr) const {
+        if (expr.type() == BigComplexType) {
+            const BigComplex * const other = static_cast<const BigComplex*>(&expr);
+            return _real == other->_real && _imag == other->_imag;
+        } else {
+            return false;
+        }
+    }
+
+    virtual hash_t hash() const {
+        // see BigReal::hash().
+        return hash_mix(hash_mix(big_complex_hash ^ real_bits(_real.toDouble())) ^ real_bits(_imag.toDouble()));
+    }
+
+    virtual std::string fullform() const {
+        std::stringstream s; // FIXME
+        s << "Complex[" << _real << ", " << _imag << "]";
+        return s.str();
+    }
+};
+
+inline BaseExpressionRef from_primitive(const machine_complex_t &value) {
+    return Heap::MachineComplex(value);
+}
+
+// Complex[re, im] for numeric re and im, of which at least one is inexact. returns an
+// empty ref if there is no such complex number (e.g. for exact or symbolic parts).
+BaseExpressionRef complex(const BaseExpressionRef &re, const BaseExpressionRef &im);
+
+#endif //CMATHICS_COMPLEX_H
@@ -103,6 +103,13 @@ SymbolRef Definitions::lookup(const char *name) {
     }
 }
 
+void Definitions::make_immortal() {
+    for (const auto &definition : _definitions) {
+        Heap::make_immortal(definition.second.get());
+    }
+    Heap::make_immortal(_empty_list.get());
+}
+
 void Definitions::add_internal_symbol(const SymbolRef &symbol) {
     _definitions[symbol->_name] = symbol;
 }
@@ -7,8 +7,6 @@
 
 class Definitions {
 private:
-    Heap _heap;
-
     std::map<std::string,SymbolRef> _definitions;
     ExpressionRef _empty_list;
 
@@ -26,6 +24,9 @@ public:
 
     SymbolRef lookup(const char *name);
 
+    // makes all symbols defined so far immortal (see ImmortalScope). they then outlive us.
+    void make_immortal();
+
     inline const ExpressionRef &empty_list() const {
         return _empty_list;
     }
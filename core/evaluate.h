@@ -2,9 +2,13 @@
 #define CMATHICS_EVALUATE_H
 
 #include "leaves.h"
+#include "rope.h"
+#include "tensor.h"
+#include "range.h"
 
 typedef std::function<BaseExpressionRef(
 	const ExpressionRef &self,
+	bool unique,
 	const BaseExpressionRef &head,
 	const void *slice_ptr,
 	const Evaluation &evaluation)> Evaluator;
@@ -57,26 +61,150 @@ struct _HoldAllComplete {
 	}
 };
 
-class heap_storage {
+// collects the leaves of a new expression. as long as all leaves are machine integers (or
+// all are machine reals), only their raw values are kept, and to_expression() turns them into
+// a PackSlice without another pass over them. the first leaf of any other type makes us box
+// the values we have so far and go on with refs.
+
+class adaptive_storage {
 private:
+	enum State {
+		Empty,
+		MachineIntegers,
+		MachineReals,
+		Refs
+	};
+
+	State _state;
+	const size_t _capacity;
+	std::vector<machine_integer_t> _integers;
+	std::vector<machine_real_t> _reals;
 	std::vector<BaseExpressionRef> _leaves;
 
+	template<typename T>
+	inline void box(std::vector<T> &values) {
+		_leaves.reserve(std::max(_capacity, values.size() + 1));
+		for (const T &value : values) {
+			_leaves.push_back(from_primitive(value));
+		}
+		values = std::vector<T>();
+	}
+
+	inline void to_refs() {
+		switch (_state) {
+			case MachineIntegers:
+				box(_integers);
+				break;
+			case MachineReals:
+				box(_reals);
+				break;
+			case Empty:
+				_leaves.reserve(_capacity);
+				break;
+			case Refs:
+				break;
+		}
+		_state = Refs;
+	}
+
 public:
-	inline heap_storage(size_t size) {
-		_leaves.reserve(size);
+	inline adaptive_storage(size_t size) : _state(Empty), _capacity(size) {
 	}
 
-	inline heap_storage &operator<<(const BaseExpressionRef &expr) {
-		_leaves.push_back(expr);
+	inline adaptive_storage &operator<<(machine_integer_t value) {
+		if (_state == MachineIntegers) {
+			_integers.push_back(value);
+		} else if (_state == Empty) {
+			_state = MachineIntegers;
+			_integers.reserve(_capacity);
+			_integers.push_back(value);
+		} else {
+			to_refs();
+			_leaves.push_back(from_primitive(value));
+		}
 		return *this;
 	}
 
-	inline heap_storage &operator<<(BaseExpressionRef &&expr) {
+	inline adaptive_storage &operator<<(machine_real_t value) {
+		if (_state == MachineReals) {
+			_reals.push_back(value);
+		} else if (_state == Empty) {
+			_state = MachineReals;
+			_reals.reserve(_capacity);
+			_reals.push_back(value);
+		} else {
+			to_refs();
+			_leaves.push_back(from_primitive(value));
+		}
+		return *this;
+	}
+
+	inline adaptive_storage &operator<<(const mpz_class &value) {
+		if (value.fits_slong_p()) {
+			return *this << static_cast<machine_integer_t>(value.get_si());
+		} else {
+			return *this << from_primitive(value);
+		}
+	}
+
+	inline adaptive_storage &operator<<(const mpq_class &value) {
+		return *this << from_primitive(value);
+	}
+
+	inline adaptive_storage &operator<<(const BaseExpressionRef &expr) {
+		switch (_state) {
+			case Empty:
+			case MachineIntegers:
+				if (expr->type() == MachineIntegerType) {
+					return *this << static_cast<const MachineInteger*>(expr.get())->value;
+				}
+				break;
+			case MachineReals:
+				if (expr->type() == MachineRealType) {
+					return *this << static_cast<const MachineReal*>(expr.get())->value;
+				}
+				break;
+			case Refs:
+				break;
+		}
+		to_refs();
 		_leaves.push_back(expr);
 		return *this;
 	}
 
+	inline adaptive_storage &operator<<(BaseExpressionRef &&expr) {
+		if (_state == Refs) {
+			_leaves.push_back(std::move(expr));
+			return *this;
+		} else {
+			return *this << static_cast<const BaseExpressionRef&>(expr);
+		}
+	}
+
+	inline size_t size() const {
+		switch (_state) {
+			case MachineIntegers:
+				return _integers.size();
+			case MachineReals:
+				return _reals.size();
+			default:
+				return _leaves.size();
+		}
+	}
+
 	inline ExpressionRef to_expression(const BaseExpressionRef &head) {
+		// tiny expressions are never packed.
+		if (size() >= 4) {
+			switch (_state) {
+				case MachineIntegers:
+					return expression(head, PackSlice<machine_integer_t>(std::move(_integers)));
+				case MachineReals:
+					return expression(head, PackSlice<machine_real_t>(std::move(_reals)));
+				default:
+					break;
+			}
+		}
+		to_refs();
 		return expression(head, std::move(_leaves));
 	}
 };
@@ -107,7 +235,7 @@ public:
 	}
 
 	inline ExpressionRef to_expression() {
-		return _expr;
+		return Heap::intern(_expr);
 	}
 };
 
@@ -120,11 +248,58 @@ inline ExpressionRef tiny_expression(const BaseExpressionRef &head, const F &gen
 
 template<typename F>
 inline ExpressionRef expression(const BaseExpressionRef &head, const F &generate, size_t size) {
-	heap_storage storage(size);
+	adaptive_storage storage(size);
 	generate(storage);
 	return storage.to_expression(head);
 }
 
+template<typename Slice, typename F>
+void rewrite_in_place(
+	const Slice &slice,
+	BaseExpressionRef *leaves,
+	size_t i0,
+	const BaseExpressionRef &leaf0,
+	size_t end,
+	const F &f,
+	TypeMask type_mask) {
+
+	// leaves outside of type_mask are never touched, so their part of the old type mask
+	// stays valid. the rest of the type mask is rebuilt as we go.
+	TypeMask new_type_mask = slice.type_mask() & ~type_mask;
+
+	for (size_t j = 0; j < i0; j++) {
+		new_type_mask |= leaves[j]->type_mask();
+	}
+
+	leaves[i0] = leaf0;
+	new_type_mask |= leaf0->type_mask();
+
+	for (size_t j = i0 + 1; j < end; j++) {
+		BaseExpressionRef &old_leaf = leaves[j];
+
+		if ((old_leaf->type_mask() & type_mask) != 0) {
+			auto new_leaf = f(old_leaf);
+			if (new_leaf) {
+				old_leaf = std::move(new_leaf);
+			}
+		}
+
+		new_type_mask |= old_leaf->type_mask();
+	}
+
+	const size_t size = slice.size();
+	for (size_t j = end; j < size; j++) {
+		new_type_mask |= leaves[j]->type_mask();
+	}
+
+	slice.set_type_mask(new_type_mask);
+}
+
+// applies f to all leaves in [begin, end) that match type_mask, and returns a new expression
+// if f changed any of them (or if apply_head is set). if owner is given, it must hold slice
+// and be referenced by nobody but our caller; changed leaves then get written into slice
+// directly (if the slice allows that) and owner is returned.
+
 template<typename Slice, typename F>
 ExpressionRef apply(
 	const BaseExpressionRef &head,
@@ -133,26 +308,36 @@ ExpressionRef apply(
 	size_t end,
 	const F &f,
 	bool apply_head,
-	TypeMask type_mask) {
+	TypeMask type_mask,
+	const Expression *owner = nullptr) {
 
 	if ((type_mask & slice.type_mask()) != 0) {
-		/*if (_extent.use_count() == 1) {
-			// FIXME. optimize this case. we do not need to copy here.
-		}*/
-
 		for (size_t i0 = begin; i0 < end; i0++) {
-			const auto &leaf = slice[i0];
+			// leaves are borrowed for the test, so that skipping packed leaves does not allocate.
+			const bool candidate = slice.with_leaf(i0, [type_mask] (const BaseExpression &leaf) {
+				return (leaf.type_mask() & type_mask) != 0;
+			});
 
-			if ((leaf->type_mask() & type_mask) == 0) {
+			if (!candidate) {
 				continue;
 			}
 
-			const auto leaf0 = f(leaf);
+			const auto leaf0 = f(slice[i0]);
 
-			if (leaf0) { // copy is needed now
+			if (leaf0) {
+				if (owner && !apply_head) {
+					BaseExpressionRef * const leaves = slice.mutable_refs();
+					if (leaves) {
+						rewrite_in_place(slice, leaves, i0, leaf0, end, f, type_mask);
+						owner->invalidate_metadata();
+						return ExpressionRef(owner);
+					}
+				}
+
+				// copy is needed now
 				const size_t size = slice.size();
 
-				auto generate_leaves = [i0, end, size, type_mask, &slice, &f, &leaf0] (auto storage) {
+				auto generate_leaves = [i0, end, size, type_mask, &slice, &f, &leaf0] (auto &storage) {
 					for (size_t j = 0; j < i0; j++) {
 						storage << slice[j];
 					}
@@ -204,6 +389,7 @@ ExpressionRef apply(
 template<typename Slice, typename Hold>
 BaseExpressionRef evaluate(
 	const ExpressionRef &self,
+	bool unique,
 	const BaseExpressionRef &head,
 	const void *slice_ptr,
 	const Evaluation &evaluation) {
@@ -232,8 +418,10 @@ BaseExpressionRef evaluate(
 			return leaf->evaluate(leaf, evaluation);
 		},
 		head != self->_head,
-		MakeTypeMask(ExpressionType) | MakeTypeMask(SymbolType));
+		MakeTypeMask(ExpressionType) | MakeTypeMask(SymbolType),
+		unique ? self.get() : nullptr);
 
+	const bool changed = intermediate_form && intermediate_form != self;
 	if (!intermediate_form) {
 		intermediate_form = boost::static_pointer_cast<const Expression>(self);
 	}
@@ -251,7 +439,11 @@ BaseExpressionRef evaluate(
 		}
 	}
 
-	return BaseExpressionRef();
+	if (changed) {
+		return intermediate_form;
+	} else {
+		return BaseExpressionRef();
+	}
 }
 
 class Evaluate {
@@ -261,27 +453,34 @@ private:
 public:
 	template<typename Hold>
 	void fill() {
-		static_assert(1 + InPlaceSlice3Code - RefsSliceCode == NumberOfSliceTypes, "slice code ids error");
+		static_assert(1 + RangeSliceCode - RefsSliceCode == NumberOfSliceTypes, "slice code ids error");
 		_vtable[RefsSliceCode] = ::evaluate<RefsSlice, Hold>;
 		_vtable[PackSliceMachineIntegerCode] = ::evaluate<PackSlice<machine_integer_t>, Hold>;
 		_vtable[PackSliceMachineRealCode] = ::evaluate<PackSlice<machine_real_t>, Hold>;
 		_vtable[PackSliceBigIntegerCode] = ::evaluate<PackSlice<mpz_class>, Hold>;
 		_vtable[PackSliceRationalCode] = ::evaluate<PackSlice<mpq_class>, Hold>;
 		_vtable[PackSliceStringCode] = ::evaluate<PackSlice<std::string>, Hold>;
+		_vtable[PackSliceMachineComplexCode] = ::evaluate<PackSlice<machine_complex_t>, Hold>;
 		_vtable[InPlaceSlice0Code] = ::evaluate<InPlaceRefsSlice<0>, Hold>;
 		_vtable[InPlaceSlice1Code] = ::evaluate<InPlaceRefsSlice<1>, Hold>;
 		_vtable[InPlaceSlice2Code] = ::evaluate<InPlaceRefsSlice<2>, Hold>;
 		_vtable[InPlaceSlice3Code] = ::evaluate<InPlaceRefsSlice<3>, Hold>;
+		_vtable[RopeSliceCode] = ::evaluate<RopeSlice, Hold>;
+		_vtable[TensorSliceMachineIntegerCode] = ::evaluate<TensorSlice<machine_integer_t>, Hold>;
+		_vtable[TensorSliceMachineRealCode] = ::evaluate<TensorSlice<machine_real_t>, Hold>;
+		_vtable[TensorSliceMachineComplexCode] = ::evaluate<TensorSlice<machine_complex_t>, Hold>;
+		_vtable[RangeSliceCode] = ::evaluate<RangeSlice, Hold>;
 	}
 
 	inline BaseExpressionRef operator()(
 		const ExpressionRef &self,
+		bool unique,
 		const BaseExpressionRef &head,
 		SliceTypeId slice_id,
 		const void *slice_ptr,
 		const Evaluation &evaluation) const {
 
-		return _vtable[slice_id](self, head, slice_ptr, evaluation);
+		return _vtable[slice_id](self, unique, head, slice_ptr, evaluation);
 	}
 };
 
@@ -8,13 +8,17 @@
 #include "evaluation.h"
 #include "pattern.h"
 
-Evaluation::Evaluation(Definitions &new_definitions, bool new_catch_interrupts) : definitions(new_definitions) {
+Evaluation::Evaluation(Definitions &new_definitions, bool new_catch_interrupts, bool new_use_arena) :
+    definitions(new_definitions) {
     recursion_depth = 0;
     timeout = false;
     stopped = false;
     catch_interrupts = new_catch_interrupts;
     interrupt = NoInterrupt;
     out = NULL;
+    use_arena = new_use_arena;
+    defer_release = false;
+    memory_limit = 0;
 }
 
 
@@ -32,11 +36,25 @@ BaseExpressionRef Evaluation::evaluate(BaseExpressionRef expr) {
     // TODO In[$Line]
     // line_no = get_line_no(evaluation);
 
-    // perform evaluation
-    auto evaluated = expr->evaluate(expr, *this);
-	if (evaluated) {
-		expr = evaluated;
-	}
+    // perform evaluation. all intermediate forms live in the arena (if enabled), only
+    // the result gets copied out of it.
+    try {
+        const MemoryBudget budget(memory_limit);
+        const DeferredRelease deferred(defer_release);
+
+        BaseExpressionRef evaluated;
+        {
+            const ArenaScope arena(use_arena);
+            evaluated = expr->evaluate(expr, *this);
+        }
+        if (evaluated) {
+            expr = Heap::promote(evaluated);
+        }
+    } catch (const MemoryLimitExceeded&) {
+        // everything allocated so far got released while unwinding.
+        interrupt = AbortInterrupt;
+        expr = definitions.lookup("System`$Aborted");
+    }
 
     // TODO $Post
 
@@ -53,7 +53,17 @@ public:
     EvaluationInterrupt interrupt;
     Out* out;
 
-    Evaluation(Definitions &definitions, bool new_catch_interrupts);
+    // if set, temporaries are allocated from the current thread's Arena, see ArenaScope.
+    bool use_arena;
+
+    // if set, objects released during evaluation are freed in batches, see DeferredRelease.
+    bool defer_release;
+
+    // if not 0, the bytes the evaluation may allocate at most (see MemoryBudget). an
+    // evaluation exceeding it gets aborted and yields $Aborted.
+    size_t memory_limit;
+
+    Evaluation(Definitions &definitions, bool new_catch_interrupts, bool new_use_arena = true);
 
     BaseExpressionRef evaluate(BaseExpressionRef expression);
 };
@@ -3,7 +3,7 @@
 #include "evaluate.h"
 
 BaseExpressionRef Expression::evaluate_expression(
-	const BaseExpressionRef &self, const Evaluation &evaluation) const {
+	const BaseExpressionRef &self, bool unique, const Evaluation &evaluation) const {
 
 	// Evaluate the head
 
@@ -39,6 +39,7 @@ BaseExpressionRef Expression::evaluate_expression(
 
 		return head_symbol->evaluate_with_head()(
 			boost::static_pointer_cast<const Expression>(self),
+			unique,
 			head,
 			slice_type_id(),
 			_slice_ptr,
@@ -7,7 +7,11 @@
 #include "operations.h"
 #include "string.h"
 #include "leaves.h"
+#include "rope.h"
+#include "tensor.h"
+#include "range.h"
 #include "structure.h"
+#include "vectorized.h"
 
 #include <sstream>
 #include <vector>
@@ -23,9 +27,61 @@ public:
     }
 };
 
+inline ExpressionMetadata metadata_of(const BaseExpression &expr) {
+	switch (expr.type()) {
+		case ExpressionType:
+			return static_cast<const Expression&>(expr).metadata();
+		case SymbolType:
+			return ExpressionMetadata{expr.hash(), symbol_filter(&expr), 1, 1};
+		default:
+			return ExpressionMetadata{expr.hash(), 0, 1, 1};
+	}
+}
+
+// the metadata of all leaves of slice taken together: their hash is the hash_leaf() chain of
+// the leaves' hashes, and their depth is that of the deepest leaf (0 if there are none).
+template<typename Slice>
+inline ExpressionMetadata leaves_metadata(const Slice &slice) {
+	ExpressionMetadata metadata{0, 0, 0, 0};
+
+	const size_t size = slice.size();
+	for (size_t i = 0; i < size; i++) {
+		const ExpressionMetadata leaf = slice.with_leaf(i, [] (const BaseExpression &leaf) {
+			return metadata_of(leaf);
+		});
+		metadata.hash = hash_leaf(metadata.hash, leaf.hash);
+		metadata.symbols |= leaf.symbols;
+		metadata.leaf_count += leaf.leaf_count;
+		metadata.depth = std::max(metadata.depth, leaf.depth);
+	}
+
+	return metadata;
+}
+
+inline ExpressionMetadata leaves_metadata(const PackSlice<machine_integer_t> &slice) {
+	const size_t size = slice.size();
+	return ExpressionMetadata{hash_machine_integers(slice.data(), size), 0, size, size > 0 ? 1u : 0u};
+}
+
+inline ExpressionMetadata leaves_metadata(const PackSlice<machine_real_t> &slice) {
+	const size_t size = slice.size();
+	return ExpressionMetadata{hash_machine_reals(slice.data(), size), 0, size, size > 0 ? 1u : 0u};
+}
+
 template<typename Slice>
 class ExpressionImplementation :
 	public Expression, public AllOperationsImplementation<ExpressionImplementation<Slice>> {
+protected:
+	virtual void compute_metadata(ExpressionMetadata &metadata) const {
+		const ExpressionMetadata head = metadata_of(*_head);
+		const ExpressionMetadata leaves = leaves_metadata(_leaves);
+
+		const hash_t hash = hash_expression(head.hash, _leaves.size(), leaves.hash);
+
+		metadata = ExpressionMetadata{
+			hash, head.symbols | leaves.symbols, head.leaf_count + leaves.leaf_count, leaves.depth + 1};
+	}
+
 public:
 	virtual ExpressionRef slice(index_t begin, index_t end = INDEX_MAX) const;
 
@@ -51,6 +107,12 @@ public:
 		return _leaves[i];
 	}
 
+	virtual bool same_leaf(size_t i, const BaseExpression &item) const {
+		return _leaves.with_leaf(i, [&item] (const BaseExpression &leaf) {
+			return leaf.same(item);
+		});
+	}
+
 	inline auto leaves() const {
 		return _leaves.leaves();
 	}
@@ -80,11 +142,19 @@ public:
 		if (this == &item) {
 			return true;
 		}
+		if (interned_with(item)) {
+			return false;
+		}
 		if (item.type() != ExpressionType) {
 			return false;
 		}
 		const Expression *expr = static_cast<const Expression *>(&item);
 
+		// only compare hashes we already have, computing them costs as much as comparing.
+		if (has_metadata() && expr->has_metadata() && metadata().hash != expr->metadata().hash) {
+			return false;
+		}
+
 		if (!_head->same(expr->head())) {
 			return false;
 		}
@@ -93,8 +163,12 @@ public:
 		if (size != expr->size()) {
 			return false;
 		}
+		// leaves are borrowed on both sides, so comparing packed leaves does not allocate.
 		for (size_t i = 0; i < size; i++) {
-			if (!_leaves[i]->same(expr->leaf(i))) {
+			const bool same = _leaves.with_leaf(i, [expr, i] (const BaseExpression &leaf) {
+				return expr->same_leaf(i, leaf);
+			});
+			if (!same) {
 				return false;
 			}
 		}
@@ -103,11 +177,7 @@ public:
 	}
 
 	virtual hash_t hash() const {
-		hash_t result = hash_combine(result, _head->hash());
-		for (auto leaf : _leaves.leaves()) {
-			result = hash_combine(result, leaf->hash());
-		}
-		return result;
+		return metadata().hash;
 	}
 
 	virtual std::string fullform() const {
@@ -198,6 +268,25 @@ std::vector<T> collect(const std::vector<BaseExpressionRef> &leaves) {
 	return values;
 }
 
+template<typename T>
+std::vector<T> collect_primitives(const std::vector<BaseExpressionRef> &leaves) {
+	std::vector<T> values;
+	values.reserve(leaves.size());
+	for (auto leaf : leaves) {
+		values.push_back(to_primitive<T>(leaf));
+	}
+	return values;
+}
+
+inline StringExtent::Ref collect_strings(const std::vector<BaseExpressionRef> &leaves) {
+	std::vector<std::experimental::string_view> values;
+	values.reserve(leaves.size());
+	for (const BaseExpressionRef &leaf : leaves) {
+		values.push_back(static_cast<const String*>(leaf.get())->value);
+	}
+	return StringExtent::construct(values.size(), values.begin());
+}
+
 template<typename T>
 inline ExpressionRef tiny_expression(const BaseExpressionRef &head, const T &leaves) {
 	const auto size = leaves.size();
@@ -232,11 +321,29 @@ inline ExpressionRef expression(
 			case MakeTypeMask(MachineRealType):
 				return expression(head, PackSlice<machine_real_t>(
 					collect<MachineReal, machine_real_t>(leaves)));
-			case MakeTypeMask(StringType):
-				return expression(head, PackSlice<std::string>(
-					collect<String, std::string>(leaves)));
+			case MakeTypeMask(StringType): {
+				const StringExtent::Ref extent = collect_strings(leaves);
+				return expression(head, PackSlice<std::string>(extent, 0, extent->size()));
+			}
+			case MakeTypeMask(BigIntegerType):
+			case MakeTypeMask(BigIntegerType) | MakeTypeMask(MachineIntegerType):
+				return expression(head, PackSlice<mpz_class>(
+					collect_primitives<mpz_class>(leaves)));
+			case MakeTypeMask(RationalType):
+				return expression(head, PackSlice<mpq_class>(
+					collect<Rational, mpq_class>(leaves)));
+			case MakeTypeMask(MachineComplexType):
+				return expression(head, PackSlice<machine_complex_t>(
+					collect<MachineComplex, machine_complex_t>(leaves)));
+			case MakeTypeMask(ExpressionType): {
+				const ExpressionRef tensor = pack_tensor(head, leaves);
+				if (tensor) {
+					return tensor;
+				}
+				return Heap::Expression(head, std::move(leaves), type_mask);
+			}
 			default:
-				return Heap::Expression(head, RefsSlice(leaves, type_mask));
+				return Heap::Expression(head, std::move(leaves), type_mask);
 		}
 	}
 }
@@ -248,7 +355,7 @@ inline ExpressionRef expression(
 	if (leaves.size() < 4) {
 		return tiny_expression(head, leaves);
 	} else {
-		return Heap::Expression(head, RefsSlice(leaves, OptionalTypeMask()));
+		return Heap::Expression(head, std::vector<BaseExpressionRef>(leaves), OptionalTypeMask());
 	}
 }
 
@@ -261,6 +368,19 @@ inline ExpressionRef expression(const BaseExpressionRef &head, const InPlaceRefs
     return Heap::Expression(head, slice);
 }
 
+inline ExpressionRef expression(const BaseExpressionRef &head, const RopeSlice &slice) {
+	return Heap::Expression(head, slice);
+}
+
+template<typename U>
+inline ExpressionRef expression(const BaseExpressionRef &head, const TensorSlice<U> &slice) {
+	return Heap::Expression(head, slice);
+}
+
+inline ExpressionRef expression(const BaseExpressionRef &head, const RangeSlice &slice) {
+	return Heap::Expression(head, slice);
+}
+
 template<typename Slice>
 ExpressionRef ExpressionImplementation<Slice>::slice(index_t begin, index_t end) const {
 	return expression(_head, _leaves.slice(begin, end));
@@ -292,7 +412,7 @@ RefsExpressionRef ExpressionImplementation<Slice>::to_refs_expression(const Base
 		for (auto leaf : _leaves.leaves()) {
 			leaves.push_back(leaf);
 		}
-		return Heap::Expression(_head, RefsSlice(std::move(leaves), _leaves.type_mask()));
+		return Heap::Expression(_head, std::move(leaves), _leaves.type_mask());
 
 	}
 }
@@ -310,6 +430,10 @@ BaseExpressionRef ExpressionImplementation<Slice>::evaluate_from_symbol_head(
 
 template<typename Slice>
 BaseExpressionRef ExpressionImplementation<Slice>::replace_all(const Match &match) const {
+	if ((metadata().symbols & match.symbols()) == 0) {
+		return BaseExpressionRef(); // none of the variables occurs here
+	}
+
 	const BaseExpressionRef &old_head = _head;
 	const BaseExpressionRef new_head = old_head->replace_all(match);
 	return apply(
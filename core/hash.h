@@ -1,13 +1,16 @@
 #ifndef HASH_H
 #define HASH_H
 
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
 typedef uint64_t hash_t;
 
-inline hash_t djb2(const char* str) {
-    uint64_t result;
-    int c;
+constexpr hash_t djb2(const char* str) {
+    uint64_t result = 5381;
+    int c = 0;
 
-    result = 5381;
     while ((c = *str++)) {
         result = ((result << 5) + result) + c;
     }
@@ -31,11 +34,74 @@ inline hash_t hash_pair(const uint64_t x, const uint64_t y) {
 }
 
 
-extern const hash_t symbol_hash;
-extern const hash_t machine_integer_hash;
-extern const hash_t machine_real_hash;
-extern const hash_t string_hash;
-extern const hash_t rational_hash;
+// the finalizer of MurmurHash3. it is a bijection, so it never adds collisions, and each bit
+// of x affects all bits of the result.
+inline hash_t hash_mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// FNV-1a, finished with hash_mix().
+inline hash_t hash_bytes(uint64_t seed, const void *data, size_t n) {
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    uint64_t result = seed ^ 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < n; i++) {
+        result ^= bytes[i];
+        result *= 0x100000001b3ULL;
+    }
+    return hash_mix(result ^ n);
+}
+
+// the bits of x, with 0. and -0. mapped to the same value, as they are the same().
+inline uint64_t real_bits(double x) {
+    if (x == 0.) {
+        return 0;
+    }
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+// the hash of an expression's leaves is the polynomial h[0] K^(n-1) + ... + h[n-1] K^0
+// (mod 2^64) over the leaves' hashes h, which vectorized code can evaluate in lanes (see
+// hash_machine_integers()).
+constexpr uint64_t LeafHashFactor = 0x9e3779b97f4a7c15ULL;
 
+inline hash_t hash_leaf(hash_t leaves, hash_t leaf) {
+    return leaves * LeafHashFactor + leaf;
+}
+
+// seeds, one for each type.
+constexpr hash_t symbol_hash = djb2("Symbol");
+constexpr hash_t machine_integer_hash = djb2("MachineInteger");
+constexpr hash_t machine_real_hash = djb2("MachineReal");
+constexpr hash_t machine_complex_hash = djb2("MachineComplex");
+constexpr hash_t string_hash = djb2("String");
+constexpr hash_t rational_hash = djb2("Rational");
+constexpr hash_t big_integer_hash = djb2("BigInteger");
+constexpr hash_t big_real_hash = djb2("BigReal");
+constexpr hash_t big_complex_hash = djb2("BigComplex");
+constexpr hash_t expression_hash = djb2("Expression");
+
+inline hash_t hash_machine_integer(int64_t x) {
+    return hash_mix(machine_integer_hash ^ uint64_t(x));
+}
+
+inline hash_t hash_machine_real(double x) {
+    return hash_mix(machine_real_hash ^ real_bits(x));
+}
+
+inline hash_t hash_machine_complex(double re, double im) {
+    return hash_mix(hash_mix(machine_complex_hash ^ real_bits(re)) ^ real_bits(im));
+}
+
+// leaves is the hash_leaf() polynomial over the expression's size leaves.
+inline hash_t hash_expression(hash_t head, size_t size, hash_t leaves) {
+    return hash_mix(hash_combine(hash_combine(hash_combine(expression_hash, head), size), leaves));
+}
 
 #endif
@@ -1,34 +1,437 @@
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
 #include "types.h"
 #include "heap.h"
 #include "integer.h"
+#include "complex.h"
 #include "leaves.h"
 #include "expression.h"
+#include "rope.h"
+#include "tensor.h"
+#include "range.h"
 #include "definitions.h"
 #include "matcher.h"
 
-Heap *Heap::_s_instance = nullptr;
+SlabPool::SlabPool(Heap *heap, size_t size, size_t align) :
+    _heap(heap),
+    _slot_size((std::max(size, sizeof(Slot)) + align - 1) & ~(align - 1)),
+    _slot_offset((sizeof(Page) + align - 1) & ~(align - 1)),
+    _pages(nullptr),
+    _free_pages(nullptr),
+    _current(nullptr),
+    _remote_free(nullptr),
+    _remote_frees(0) {
+
+    assert((align & (align - 1)) == 0);
+    assert(_slot_offset + _slot_size <= PoolPageSize);
+}
+
+SlabPool::~SlabPool() {
+    Page *page = _pages;
+    while (page) {
+        Page * const next = page->next_page;
+        std::free(page);
+        page = next;
+    }
+}
+
+void SlabPool::drain_remote() {
+    Slot *slot = _remote_free.exchange(nullptr, std::memory_order_acquire);
+    while (slot) {
+        Slot * const next = slot->next;
+        _remote_frees.fetch_sub(1, std::memory_order_relaxed);
+        deallocate(slot);
+        slot = next;
+    }
+}
+
+SlabPool::Page *SlabPool::next_page() {
+    if (_remote_free.load(std::memory_order_relaxed)) {
+        drain_remote();
+    }
+
+    Page *page = _free_pages;
+
+    if (page) {
+        _free_pages = page->next_free_page;
+        page->stacked = false;
+    } else {
+        void *memory;
+        if (posix_memalign(&memory, PoolPageSize, PoolPageSize) != 0) {
+            throw std::bad_alloc();
+        }
+
+        _reserved_pages.add(1);
+
+        page = static_cast<Page*>(memory);
+        page->pool = this;
+        page->arena = nullptr;
+        page->next_page = _pages;
+        page->next_free_page = nullptr;
+        page->used = 0;
+        page->stacked = false;
+        _pages = page;
+
+        // thread all slots of the new page into its free list, lowest address first.
+        char * const begin = static_cast<char*>(memory) + _slot_offset;
+        const size_t n = (PoolPageSize - _slot_offset) / _slot_size;
+        Slot *free = nullptr;
+        for (size_t i = n; i > 0; i--) {
+            Slot * const slot = reinterpret_cast<Slot*>(begin + (i - 1) * _slot_size);
+            slot->next = free;
+            free = slot;
+        }
+        page->free = free;
+    }
+
+    _current = page;
+    return page;
+}
+
+Arena::Arena(Heap *heap) : _heap(heap), _current(nullptr), _free_chunks(nullptr) {
+}
+
+Arena::Chunk *Arena::next_chunk(size_t size) {
+    assert(chunk_offset() + size <= PoolPageSize);
+
+    Chunk *chunk = _free_chunks;
+
+    if (chunk) {
+        _free_chunks = chunk->next_free_chunk;
+    } else {
+        void *memory;
+        if (posix_memalign(&memory, PoolPageSize, PoolPageSize) != 0) {
+            throw std::bad_alloc();
+        }
+
+        _reserved_chunks.add(1);
+
+        chunk = static_cast<Chunk*>(memory);
+        chunk->pool = nullptr;
+        chunk->arena = this;
+        chunk->top = static_cast<char*>(memory) + chunk_offset();
+        chunk->live = 0;
+    }
+
+    // the old chunk still has live objects (otherwise it would have been reset); it
+    // gets recycled by deallocate() as soon as the last of them goes away.
+    _chunks_in_use.add_tracking_peak(1, _peak_chunks);
+    _current = chunk;
+    return chunk;
+}
+
+alignas(16) char Immediates::_s_integers[NumberOfIntegers * SlotSize];
+
+bool Immediates::init() {
+    static_assert(sizeof(class MachineInteger) <= SlotSize, "MachineInteger does not fit into an immediate slot");
+    static_assert(alignof(class MachineInteger) <= 16, "MachineInteger is not aligned properly for immediates");
+
+    for (size_t i = 0; i < NumberOfIntegers; i++) {
+        class MachineInteger * const integer = new(_s_integers + i * SlotSize) class MachineInteger(
+            MinInteger + machine_integer_t(i));
+        Heap::make_immortal(integer);
+        // integer() relies on this.
+        assert(static_cast<BaseExpression*>(integer) == static_cast<void*>(integer));
+    }
+    return true;
+}
+
+namespace {
+    // a refs block starts with the expression, followed by its RefsExtent.
+
+    constexpr size_t refs_block_offset() {
+        return (sizeof(ExpressionImplementation<RefsSlice>) + alignof(RefsExtent) - 1) & ~(alignof(RefsExtent) - 1);
+    }
+
+    constexpr size_t refs_block_align() {
+        return std::max(alignof(ExpressionImplementation<RefsSlice>), alignof(RefsExtent));
+    }
+
+    constexpr size_t refs_block_capacity(size_t k) {
+        return size_t(8) << k;
+    }
+
+    constexpr size_t refs_block_size(size_t k) {
+        return refs_block_offset() + RefsExtent::allocation_size(refs_block_capacity(k));
+    }
+
+    inline size_t refs_block_class(size_t n) {
+        size_t k = 0;
+        while (refs_block_capacity(k) < n) {
+            k++;
+        }
+        return k;
+    }
+}
+
+void RefsExtent::destroy(RefsExtent *extent) {
+    BaseExpressionRef * const data = extent->data();
+    for (size_t i = 0; i < extent->_size; i++) {
+        data[i].~BaseExpressionRef();
+    }
+
+    void * const block = extent->_block;
+    const size_t size = extent->_size;
+    extent->~RefsExtent();
+    if (block) {
+        Heap::deallocate(block);
+        Heap::credit(refs_block_offset() + allocation_size(size));
+    } else {
+        Heap::extent_freed(allocation_size(size));
+        ::operator delete(extent);
+    }
+}
+
+void InternTable::grow() {
+    std::vector<Entry> entries(std::max(2 * _entries.size(), size_t(64)), Entry{0, nullptr});
+    const size_t mask = entries.size() - 1;
+    for (const Entry &entry : _entries) {
+        if (entry.expr) {
+            size_t i = entry.hash & mask;
+            while (entries[i].expr) {
+                i = (i + 1) & mask;
+            }
+            entries[i] = entry;
+        }
+    }
+    _entries.swap(entries);
+}
+
+void InternTable::insert(hash_t hash, BaseExpression *expr) {
+    // a load factor of at most 1/2 keeps probe sequences short.
+    if (2 * (_size + 1) > _entries.size()) {
+        grow();
+    }
+    const size_t mask = _entries.size() - 1;
+    size_t i = hash & mask;
+    while (_entries[i].expr) {
+        i = (i + 1) & mask;
+    }
+    _entries[i] = Entry{hash, expr};
+    _size++;
+}
+
+void InternTable::erase(hash_t hash, const BaseExpression *expr) {
+    const size_t mask = _entries.size() - 1;
+    size_t i = hash & mask;
+    while (_entries[i].expr != expr) {
+        assert(_entries[i].expr);
+        i = (i + 1) & mask;
+    }
+
+    // moves later entries back into the gap, unless the gap lies before their home slot.
+    size_t gap = i;
+    for (size_t j = (i + 1) & mask; _entries[j].expr; j = (j + 1) & mask) {
+        const size_t home = _entries[j].hash & mask;
+        if (((j - home) & mask) >= ((j - gap) & mask)) {
+            _entries[gap] = _entries[j];
+            gap = j;
+        }
+    }
+    _entries[gap].expr = nullptr;
+    _size--;
+}
+
+thread_local Heap *Heap::_s_instance = nullptr;
+
+thread_local ReleaseList Heap::_s_release_list = {nullptr, 0, false, false};
+
+thread_local MemoryBudgetState Heap::_s_budget = {0, std::numeric_limits<size_t>::max()};
+
+thread_local std::vector<ImmortalEvent> *Heap::_s_immortal_log = nullptr;
+
+constexpr size_t Heap::ReleaseBatchSize;
+
+std::mutex Heap::_s_mutex;
+
+std::vector<Heap*> &Heap::heaps() {
+    // never destroyed, as threads might still exit after static destruction.
+    static std::vector<Heap*> * const heaps = new std::vector<Heap*>();
+    return *heaps;
+}
+
+std::vector<Heap*> &Heap::abandoned_heaps() {
+    static std::vector<Heap*> * const abandoned = new std::vector<Heap*>();
+    return *abandoned;
+}
+
+std::atomic<Heap*> Heap::_s_interning_heaps[255];
 
-void Heap::init() {
+std::atomic<size_t> Heap::_s_extent_bytes(0);
+std::atomic<size_t> Heap::_s_extent_peak(0);
+std::atomic<size_t> Heap::_s_extent_allocations(0);
+
+namespace {
+    class ThreadHeap {
+    public:
+        Heap *heap = nullptr;
+
+        ~ThreadHeap() {
+            if (heap) {
+                Heap::abandon(heap);
+            }
+        }
+    };
+
+    thread_local ThreadHeap s_thread_heap;
+}
+
+Heap::Heap(uint8_t intern_id) :
+    _machine_integers(this),
+    _big_integers(this),
+    _machine_reals(this),
+    _big_reals(this),
+    _machine_complexes(this),
+    _big_complexes(this),
+    _strings(this),
+    _expression0(this),
+    _expression1(this),
+    _expression2(this),
+    _expression3(this),
+    _expression_refs(this),
+    _refs_blocks{
+        {this, refs_block_size(0), refs_block_align()},
+        {this, refs_block_size(1), refs_block_align()},
+        {this, refs_block_size(2), refs_block_align()},
+        {this, refs_block_size(3), refs_block_align()},
+        {this, refs_block_size(4), refs_block_align()},
+        {this, refs_block_size(5), refs_block_align()}},
+    _expression_machine_integers(this),
+    _expression_machine_reals(this),
+    _expression_big_integers(this),
+    _expression_rationals(this),
+    _expression_strings(this),
+    _expression_machine_complexes(this),
+    _expression_ropes(this),
+    _expression_machine_integer_tensors(this),
+    _expression_machine_real_tensors(this),
+    _expression_machine_complex_tensors(this),
+    _expression_ranges(this),
+    _arena(this),
+    _use_arena(false),
+    _intern_id(intern_id),
+    _interning(false),
+    _remote_interned(nullptr) {
+}
+
+Heap *Heap::init() {
     assert(_s_instance == nullptr);
-    _s_instance = new Heap();
+
+    Heap *heap = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(_s_mutex);
+        std::vector<Heap*> &abandoned = abandoned_heaps();
+        if (!abandoned.empty()) {
+            heap = abandoned.back();
+            abandoned.pop_back();
+        } else {
+            std::vector<Heap*> &all = heaps();
+            heap = new Heap(all.size() < 255 ? uint8_t(all.size() + 1) : 0);
+            all.push_back(heap);
+            if (heap->_intern_id) {
+                _s_interning_heaps[heap->_intern_id - 1].store(heap, std::memory_order_release);
+            }
+        }
+    }
+
+    _s_instance = heap;
+    s_thread_heap.heap = heap;
+    return heap;
+}
+
+void Heap::abandon(Heap *heap) {
+    // objects this thread still releases from now on go through the remote free lists.
+    if (_s_instance == heap) {
+        _s_instance = nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(_s_mutex);
+    abandoned_heaps().push_back(heap);
 }
 
 void Heap::release(BaseExpression *expr) {
+    ReleaseList &list = _s_release_list;
+
+    // a queued object must not be found (and handed out again) until it is freed.
+    if (expr->_interned) {
+        Heap * const owner = _s_interning_heaps[expr->_interned - 1].load(std::memory_order_acquire);
+        if (owner != _s_instance) {
+            owner->release_interned_remote(expr);
+            return;
+        }
+        owner->_intern_table.erase(expr->hash(), expr);
+        expr->_interned = 0;
+    }
+
+    expr->_ref_count = reinterpret_cast<size_t>(list.head);
+    list.head = expr;
+    list.size++;
+
+    if (list.draining || (list.deferred && list.size < ReleaseBatchSize)) {
+        return;
+    }
+
+    drain();
+}
+
+void Heap::drain_interned_remote() {
+    BaseExpression *expr = _remote_interned.exchange(nullptr, std::memory_order_acquire);
+    while (expr) {
+        BaseExpression * const next = reinterpret_cast<BaseExpression*>(expr->_ref_count);
+        release(expr); // erases it, as we own it
+        expr = next;
+    }
+}
+
+void Heap::drain() {
+    ReleaseList &list = _s_release_list;
+    if (list.draining) {
+        return;
+    }
+
+    // freeing an object might queue further objects, which we pick up in the same loop.
+    list.draining = true;
+    while (list.head) {
+        BaseExpression * const expr = list.head;
+        list.head = reinterpret_cast<BaseExpression*>(expr->_ref_count);
+        list.size--;
+        free(expr);
+    }
+    list.draining = false;
+}
+
+void Heap::free(BaseExpression *expr) {
+    log_immortal(expr, false);
+
     switch (expr->type()) {
         case MachineIntegerType:
-            _s_instance->_machine_integers.free(static_cast<class MachineInteger*>(expr));
+            destroy(static_cast<class MachineInteger*>(expr));
             break;
 
         case BigIntegerType:
-            _s_instance->_big_integers.free(static_cast<class BigInteger*>(expr));
+            destroy(static_cast<class BigInteger*>(expr));
             break;
 
         case MachineRealType:
-            _s_instance->_machine_reals.free(static_cast<class MachineReal*>(expr));
+            destroy(static_cast<class MachineReal*>(expr));
             break;
 
         case BigRealType:
-            _s_instance->_big_reals.free(static_cast<class BigReal*>(expr));
+            destroy(static_cast<class BigReal*>(expr));
+            break;
+
+        case MachineComplexType:
+            destroy(static_cast<class MachineComplex*>(expr));
+            break;
+
+        case BigComplexType:
+            destroy(static_cast<class BigComplex*>(expr));
+            break;
+
+        case StringType:
+            destroy(static_cast<class String*>(expr));
             break;
 
         case ExpressionType: {
@@ -36,29 +439,74 @@ void Heap::release(BaseExpression *expr) {
             if (is_in_place_slice(type_id)) {
                 switch (in_place_slice_size(type_id)) {
                     case 0:
-                        _s_instance->_expression0.free(
-                            static_cast<ExpressionImplementation<InPlaceRefsSlice<0>>*>(expr));
+                        destroy(static_cast<ExpressionImplementation<InPlaceRefsSlice<0>>*>(expr));
                         break;
                     case 1:
-                        _s_instance->_expression1.free(
-                            static_cast<ExpressionImplementation<InPlaceRefsSlice<1>>*>(expr));
+                        destroy(static_cast<ExpressionImplementation<InPlaceRefsSlice<1>>*>(expr));
                         break;
                     case 2:
-                        _s_instance->_expression2.free(
-                            static_cast<ExpressionImplementation<InPlaceRefsSlice<2>>*>(expr));
+                        destroy(static_cast<ExpressionImplementation<InPlaceRefsSlice<2>>*>(expr));
                         break;
                     case 3:
-                        _s_instance->_expression3.free(
-                            static_cast<ExpressionImplementation<InPlaceRefsSlice<3>>*>(expr));
+                        destroy(static_cast<ExpressionImplementation<InPlaceRefsSlice<3>>*>(expr));
                         break;
                     default:
                         throw std::runtime_error("encountered unsupported in-place-slice size");
                 }
             } else if (type_id == SliceTypeId::RefsSliceCode) {
-                _s_instance->_expression_refs.free(
-                    static_cast<ExpressionImplementation<RefsSlice>*>(expr));
+                const auto refs_expr = static_cast<ExpressionImplementation<RefsSlice>*>(expr);
+                const RefsExtent::Ref &extent = refs_expr->_leaves.extent();
+                if (extent && extent->block() == refs_expr) {
+                    // the block is freed along with the last reference to its extent, which
+                    // must not happen before the expression is completely destroyed.
+                    const RefsExtent::Ref keep_block(extent);
+                    refs_expr->~ExpressionImplementation<RefsSlice>();
+                } else {
+                    destroy(refs_expr);
+                }
             } else if (is_pack_slice(type_id)) {
-                delete expr;
+                switch (type_id) {
+                    case PackSliceMachineIntegerCode:
+                        destroy(static_cast<ExpressionImplementation<PackSlice<machine_integer_t>>*>(expr));
+                        break;
+                    case PackSliceMachineRealCode:
+                        destroy(static_cast<ExpressionImplementation<PackSlice<machine_real_t>>*>(expr));
+                        break;
+                    case PackSliceBigIntegerCode:
+                        destroy(static_cast<ExpressionImplementation<PackSlice<mpz_class>>*>(expr));
+                        break;
+                    case PackSliceRationalCode:
+                        destroy(static_cast<ExpressionImplementation<PackSlice<mpq_class>>*>(expr));
+                        break;
+                    case PackSliceStringCode:
+                        destroy(static_cast<ExpressionImplementation<PackSlice<std::string>>*>(expr));
+                        break;
+                    case PackSliceMachineComplexCode:
+                        destroy(static_cast<ExpressionImplementation<PackSlice<machine_complex_t>>*>(expr));
+                        break;
+                    default:
+                        throw std::runtime_error("encountered unsupported pack slice type id");
+                }
+            } else if (type_id == SliceTypeId::RopeSliceCode) {
+                // rope nodes are reference counted; chunks that lose their last reference
+                // get released through the usual (possibly deferred) path.
+                destroy(static_cast<ExpressionImplementation<RopeSlice>*>(expr));
+            } else if (is_tensor_slice(type_id)) {
+                switch (type_id) {
+                    case TensorSliceMachineIntegerCode:
+                        destroy(static_cast<ExpressionImplementation<TensorSlice<machine_integer_t>>*>(expr));
+                        break;
+                    case TensorSliceMachineRealCode:
+                        destroy(static_cast<ExpressionImplementation<TensorSlice<machine_real_t>>*>(expr));
+                        break;
+                    case TensorSliceMachineComplexCode:
+                        destroy(static_cast<ExpressionImplementation<TensorSlice<machine_complex_t>>*>(expr));
+                        break;
+                    default:
+                        throw std::runtime_error("encountered unsupported tensor slice type id");
+                }
+            } else if (type_id == SliceTypeId::RangeSliceCode) {
+                destroy(static_cast<ExpressionImplementation<RangeSlice>*>(expr));
             } else {
                 throw std::runtime_error("encountered unsupported slice type id");
             }
@@ -72,71 +520,723 @@ void Heap::release(BaseExpression *expr) {
 }
 
 BaseExpressionRef Heap::MachineInteger(machine_integer_t value) {
-    assert(_s_instance);
-    return BaseExpressionRef(_s_instance->_machine_integers.construct(value));
+    Heap &heap = instance();
+    if (heap.interns()) {
+        return BaseExpressionRef(heap.construct_interned(
+            heap._machine_integers, hash_machine_integer(value), [value] (const BaseExpression &expr) {
+                return expr.type() == MachineIntegerType &&
+                    static_cast<const class MachineInteger*>(&expr)->value == value;
+            }, value));
+    }
+    return BaseExpressionRef(heap.construct(heap._machine_integers, value));
 }
 
 BaseExpressionRef Heap::BigInteger(const mpz_class &value) {
-    assert(_s_instance);
-    return BaseExpressionRef(_s_instance->_big_integers.construct(value));
+    Heap &heap = instance();
+    if (heap.interns()) {
+        return BaseExpressionRef(heap.construct_interned(
+            heap._big_integers, hash_mpz(big_integer_hash, value), [&value] (const BaseExpression &expr) {
+                return expr.type() == BigIntegerType &&
+                    static_cast<const class BigInteger*>(&expr)->value == value;
+            }, value));
+    }
+    return BaseExpressionRef(heap.construct(heap._big_integers, value));
 }
 
 BaseExpressionRef Heap::MachineReal(machine_real_t value) {
-    assert(_s_instance);
-    return BaseExpressionRef(_s_instance->_machine_reals.construct(value));
+    Heap &heap = instance();
+    if (heap.interns()) {
+        // compares bits, so that 0. and -0. (or NaNs) do not get merged.
+        return BaseExpressionRef(heap.construct_interned(
+            heap._machine_reals, hash_machine_real(value), [value] (const BaseExpression &expr) {
+                return expr.type() == MachineRealType &&
+                    memcmp(&static_cast<const class MachineReal*>(&expr)->value, &value, sizeof(value)) == 0;
+            }, value));
+    }
+    return BaseExpressionRef(heap.construct(heap._machine_reals, value));
 }
 
 BaseExpressionRef Heap::BigReal(const mpfr::mpreal &value) {
-    assert(_s_instance);
-    return BaseExpressionRef(_s_instance->_big_reals.construct(value));
+    Heap &heap = instance();
+    return BaseExpressionRef(heap.construct(heap._big_reals, value));
 }
 
 BaseExpressionRef Heap::BigReal(double prec, machine_real_t value) {
-    assert(_s_instance);
-    return BaseExpressionRef(_s_instance->_big_reals.construct(prec, value));
+    Heap &heap = instance();
+    return BaseExpressionRef(heap.construct(heap._big_reals, prec, value));
+}
+
+BaseExpressionRef Heap::MachineComplex(const machine_complex_t &value) {
+    Heap &heap = instance();
+    return BaseExpressionRef(heap.construct(heap._machine_complexes, value));
+}
+
+BaseExpressionRef Heap::BigComplex(const mpfr::mpreal &real, const mpfr::mpreal &imag) {
+    Heap &heap = instance();
+    return BaseExpressionRef(heap.construct(heap._big_complexes, real, imag));
+}
+
+BaseExpressionRef Heap::String(const std::string &value) {
+    Heap &heap = instance();
+    if (heap.interns()) {
+        const std::experimental::string_view view(value);
+        return BaseExpressionRef(heap.construct_interned(
+            heap._strings, hash_bytes(string_hash, value.data(), value.size()), [&view] (const BaseExpression &expr) {
+                return expr.type() == StringType && static_cast<const class String*>(&expr)->value == view;
+            }, value));
+    }
+    return BaseExpressionRef(heap.construct(heap._strings, value));
+}
+
+BaseExpressionRef Heap::String(const StringExtent::Ref &extent, const std::experimental::string_view &value) {
+    Heap &heap = instance();
+    return BaseExpressionRef(heap.construct(heap._strings, extent, value));
+}
+
+template<size_t N>
+InPlaceExpressionRef<N> Heap::in_place_expression(
+    ObjectPool<ExpressionImplementation<InPlaceRefsSlice<N>>> &pool,
+    const BaseExpressionRef &head,
+    const InPlaceRefsSlice<N> &slice) {
+
+    // slices whose leaves get filled in later (see direct_storage) go through intern().
+    if (!interns() || (N > 0 && !slice.refs()[0])) {
+        return InPlaceExpressionRef<N>(construct(pool, head, slice));
+    }
+
+    const hash_t hash = hash_expression(metadata_of(*head).hash, N, leaves_metadata(slice).hash);
+
+    return InPlaceExpressionRef<N>(construct_interned(pool, hash, [&head, &slice] (const BaseExpression &expr) {
+        if (expr.type() != ExpressionType) {
+            return false;
+        }
+        const class Expression * const candidate = static_cast<const class Expression*>(&expr);
+        if (candidate->size() != N || !candidate->_head->same(head)) {
+            return false;
+        }
+        for (size_t i = 0; i < N; i++) {
+            if (!candidate->same_leaf(i, *slice.refs()[i])) {
+                return false;
+            }
+        }
+        return true;
+    }, head, slice));
+}
+
+ExpressionRef Heap::intern_expression(const ExpressionRef &expr) {
+    if (expr->is_interned()) {
+        return expr;
+    }
+    assert(is_in_place_slice(expr->slice_type_id()));
+    collect_interned();
+
+    const hash_t hash = expr->hash();
+    BaseExpression * const found = _intern_table.find(hash, [&expr] (const BaseExpression &candidate) {
+        return expr->same(candidate);
+    });
+    if (found) {
+        return ExpressionRef(static_cast<const class Expression*>(found));
+    }
+
+    class Expression * const interned = const_cast<class Expression*>(expr.get());
+    _intern_table.insert(hash, interned);
+    interned->_interned = _intern_id;
+    return expr;
+}
+
+size_t Heap::interned_count() {
+    Heap &heap = instance();
+    heap.collect_interned();
+    return heap._intern_table.size();
+}
+
+void Heap::make_immortal(const BaseExpression *expr) {
+    if (expr->type() == ExpressionType) {
+        // fills the caches that would otherwise get written on first use.
+        const class Expression * const expression = static_cast<const class Expression*>(expr);
+        expression->metadata();
+        expression->type_mask();
+    }
+    expr->_ref_count = ImmortalRefCount;
+}
+
+ImmortalScope::ImmortalScope() : _saved(Heap::_s_immortal_log) {
+    Heap::_s_immortal_log = &_log;
+}
+
+ImmortalScope::~ImmortalScope() {
+    // pending releases still use their reference count fields.
+    Heap::drain();
+    Heap::_s_immortal_log = _saved;
+
+    // slots might have been freed and reused, so the last event for each address counts.
+    std::stable_sort(_log.begin(), _log.end(), [] (const ImmortalEvent &a, const ImmortalEvent &b) {
+        return a.expr < b.expr;
+    });
+    const size_t n = _log.size();
+    for (size_t i = 0; i < n; i++) {
+        if ((i + 1 == n || _log[i + 1].expr != _log[i].expr) && _log[i].alive) {
+            Heap::make_immortal(_log[i].expr);
+        }
+    }
 }
 
 InPlaceExpressionRef<0> Heap::EmptyExpression0(const BaseExpressionRef &head) {
-    assert(_s_instance);
-    return InPlaceExpressionRef<0>(_s_instance->_expression0.construct(head));
+    Heap &heap = instance();
+    return heap.in_place_expression(heap._expression0, head, InPlaceRefsSlice<0>());
 }
 
 InPlaceExpressionRef<1> Heap::EmptyExpression1(const BaseExpressionRef &head) {
-    assert(_s_instance);
-    return InPlaceExpressionRef<1>(_s_instance->_expression1.construct(head));
+    Heap &heap = instance();
+    return InPlaceExpressionRef<1>(heap.construct(heap._expression1, head));
 }
 
 InPlaceExpressionRef<2> Heap::EmptyExpression2(const BaseExpressionRef &head) {
-    assert(_s_instance);
-    return InPlaceExpressionRef<2>(_s_instance->_expression2.construct(head));
+    Heap &heap = instance();
+    return InPlaceExpressionRef<2>(heap.construct(heap._expression2, head));
 }
 
 InPlaceExpressionRef<3> Heap::EmptyExpression3(const BaseExpressionRef &head) {
-    assert(_s_instance);
-    return InPlaceExpressionRef<3>(_s_instance->_expression3.construct(head));
+    Heap &heap = instance();
+    return InPlaceExpressionRef<3>(heap.construct(heap._expression3, head));
 }
 
 InPlaceExpressionRef<0> Heap::Expression(const BaseExpressionRef &head, const InPlaceRefsSlice<0> &slice) {
-    assert(_s_instance);
-    return InPlaceExpressionRef<0>(_s_instance->_expression0.construct(head));
+    Heap &heap = instance();
+    return heap.in_place_expression(heap._expression0, head, slice);
 }
 
 InPlaceExpressionRef<1> Heap::Expression(const BaseExpressionRef &head, const InPlaceRefsSlice<1> &slice) {
-    assert(_s_instance);
-    return InPlaceExpressionRef<1>(_s_instance->_expression1.construct(head, slice));
+    Heap &heap = instance();
+    return heap.in_place_expression(heap._expression1, head, slice);
 }
 
 InPlaceExpressionRef<2> Heap::Expression(const BaseExpressionRef &head, const InPlaceRefsSlice<2> &slice) {
-    assert(_s_instance);
-    return InPlaceExpressionRef<2>(_s_instance->_expression2.construct(head, slice));
+    Heap &heap = instance();
+    return heap.in_place_expression(heap._expression2, head, slice);
 }
 
 InPlaceExpressionRef<3> Heap::Expression(const BaseExpressionRef &head, const InPlaceRefsSlice<3> &slice) {
-    assert(_s_instance);
-    return InPlaceExpressionRef<3>(_s_instance->_expression3.construct(head, slice));
+    Heap &heap = instance();
+    return heap.in_place_expression(heap._expression3, head, slice);
 }
 
 RefsExpressionRef Heap::Expression(const BaseExpressionRef &head, const RefsSlice &slice) {
-    assert(_s_instance);
-    return RefsExpressionRef(_s_instance->_expression_refs.construct(head, slice));
+    Heap &heap = instance();
+    return RefsExpressionRef(heap.construct(heap._expression_refs, head, slice));
+}
+
+RefsExpressionRef Heap::Expression(
+    const BaseExpressionRef &head, std::vector<BaseExpressionRef> &&leaves, OptionalTypeMask type_mask) {
+
+    // allocates the expression and its leaves as one single block.
+
+    const size_t k = refs_block_class(leaves.size());
+    if (k >= NumberOfRefsBlockClasses) {
+        return Expression(head, RefsSlice(std::move(leaves), type_mask));
+    }
+
+    const size_t size = refs_block_offset() + RefsExtent::allocation_size(leaves.size());
+    charge(size); // credited in RefsExtent::destroy()
+
+    Heap &heap = instance();
+    void *block;
+    try {
+        block = heap._use_arena ? heap._arena.allocate(size) : heap._refs_blocks[k].allocate();
+    } catch(...) {
+        credit(size);
+        throw;
+    }
+
+    const RefsExtent::Ref extent = RefsExtent::construct(
+        static_cast<char*>(block) + refs_block_offset(), block, std::move(leaves));
+    const auto expr = new(block) ExpressionImplementation<RefsSlice>(head, RefsSlice(extent, type_mask));
+    log_immortal(expr, true);
+    return RefsExpressionRef(expr);
+}
+
+PackExpressionRef<machine_integer_t> Heap::Expression(
+    const BaseExpressionRef &head, const PackSlice<machine_integer_t> &slice) {
+    Heap &heap = instance();
+    return PackExpressionRef<machine_integer_t>(heap.construct(heap._expression_machine_integers, head, slice));
+}
+
+PackExpressionRef<machine_real_t> Heap::Expression(
+    const BaseExpressionRef &head, const PackSlice<machine_real_t> &slice) {
+    Heap &heap = instance();
+    return PackExpressionRef<machine_real_t>(heap.construct(heap._expression_machine_reals, head, slice));
+}
+
+PackExpressionRef<mpz_class> Heap::Expression(
+    const BaseExpressionRef &head, const PackSlice<mpz_class> &slice) {
+    Heap &heap = instance();
+    return PackExpressionRef<mpz_class>(heap.construct(heap._expression_big_integers, head, slice));
+}
+
+PackExpressionRef<mpq_class> Heap::Expression(
+    const BaseExpressionRef &head, const PackSlice<mpq_class> &slice) {
+    Heap &heap = instance();
+    return PackExpressionRef<mpq_class>(heap.construct(heap._expression_rationals, head, slice));
+}
+
+PackExpressionRef<std::string> Heap::Expression(
+    const BaseExpressionRef &head, const PackSlice<std::string> &slice) {
+    Heap &heap = instance();
+    return PackExpressionRef<std::string>(heap.construct(heap._expression_strings, head, slice));
+}
+
+PackExpressionRef<machine_complex_t> Heap::Expression(
+    const BaseExpressionRef &head, const PackSlice<machine_complex_t> &slice) {
+    Heap &heap = instance();
+    return PackExpressionRef<machine_complex_t>(heap.construct(heap._expression_machine_complexes, head, slice));
+}
+
+RopeExpressionRef Heap::Expression(const BaseExpressionRef &head, const RopeSlice &slice) {
+    Heap &heap = instance();
+    return RopeExpressionRef(heap.construct(heap._expression_ropes, head, slice));
+}
+
+TensorExpressionRef<machine_integer_t> Heap::Expression(
+    const BaseExpressionRef &head, const TensorSlice<machine_integer_t> &slice) {
+    Heap &heap = instance();
+    return TensorExpressionRef<machine_integer_t>(heap.construct(heap._expression_machine_integer_tensors, head, slice));
+}
+
+TensorExpressionRef<machine_real_t> Heap::Expression(
+    const BaseExpressionRef &head, const TensorSlice<machine_real_t> &slice) {
+    Heap &heap = instance();
+    return TensorExpressionRef<machine_real_t>(heap.construct(heap._expression_machine_real_tensors, head, slice));
+}
+
+TensorExpressionRef<machine_complex_t> Heap::Expression(
+    const BaseExpressionRef &head, const TensorSlice<machine_complex_t> &slice) {
+    Heap &heap = instance();
+    return TensorExpressionRef<machine_complex_t>(heap.construct(heap._expression_machine_complex_tensors, head, slice));
+}
+
+RangeExpressionRef Heap::Expression(const BaseExpressionRef &head, const RangeSlice &slice) {
+    Heap &heap = instance();
+    return RangeExpressionRef(heap.construct(heap._expression_ranges, head, slice));
+}
+
+bool Heap::is_arena_allocated(const BaseExpression *expr) {
+    // only valid for objects of pooled types (and immediates).
+    return !Immediates::contains(expr) && page_header_of(expr)->pool == nullptr;
+}
+
+namespace {
+    template<typename U>
+    inline BaseExpressionRef promote_packed(const Expression *expr, const BaseExpressionRef &head) {
+        const auto packed = static_cast<const ExpressionImplementation<PackSlice<U>>*>(expr);
+        return Heap::Expression(head, packed->_leaves);
+    }
+
+    template<typename U>
+    inline BaseExpressionRef promote_tensor(const Expression *expr, const BaseExpressionRef &head) {
+        // the row head of a tensor is a symbol, and symbols never live in an Arena.
+        const auto tensor = static_cast<const ExpressionImplementation<TensorSlice<U>>*>(expr);
+        return Heap::Expression(head, tensor->_leaves);
+    }
+
+    // an arena expression being promoted, whose head and leaves get promoted one by one.
+    struct Promotion {
+        const Expression *expr;
+        size_t size; // the number of leaves to promote, 0 if they can be shared
+        BaseExpressionRef head;
+        std::vector<BaseExpressionRef> leaves;
+
+        inline explicit Promotion(const Expression *e) : expr(e) {
+            // the extent of a pack slice never lives in an Arena, so it can be shared.
+            const SliceTypeId type_id = expr->slice_type_id();
+            size = is_pack_slice(type_id) || is_tensor_slice(type_id) || type_id == RangeSliceCode ?
+                0 : expr->size();
+            leaves.reserve(size);
+        }
+
+        inline BaseExpressionRef next() const {
+            return head ? expr->leaf(leaves.size()) : expr->_head;
+        }
+
+        inline bool done() const {
+            return head && leaves.size() == size;
+        }
+
+        inline void add(BaseExpressionRef &&promoted) {
+            if (head) {
+                leaves.push_back(std::move(promoted));
+            } else {
+                head = std::move(promoted);
+            }
+        }
+
+        BaseExpressionRef finish() {
+            switch (expr->slice_type_id()) {
+                case PackSliceMachineIntegerCode:
+                    return promote_packed<machine_integer_t>(expr, head);
+                case PackSliceMachineRealCode:
+                    return promote_packed<machine_real_t>(expr, head);
+                case PackSliceBigIntegerCode:
+                    return promote_packed<mpz_class>(expr, head);
+                case PackSliceRationalCode:
+                    return promote_packed<mpq_class>(expr, head);
+                case PackSliceStringCode:
+                    return promote_packed<std::string>(expr, head);
+                case PackSliceMachineComplexCode:
+                    return promote_packed<machine_complex_t>(expr, head);
+                case TensorSliceMachineIntegerCode:
+                    return promote_tensor<machine_integer_t>(expr, head);
+                case TensorSliceMachineRealCode:
+                    return promote_tensor<machine_real_t>(expr, head);
+                case TensorSliceMachineComplexCode:
+                    return promote_tensor<machine_complex_t>(expr, head);
+                case RangeSliceCode:
+                    return Heap::Expression(head,
+                        static_cast<const ExpressionImplementation<RangeSlice>*>(expr)->_leaves);
+                default:
+                    // rope chunks might live in the Arena, so promoting flattens the rope.
+                    return expression(head, std::move(leaves));
+            }
+        }
+    };
+}
+
+BaseExpressionRef Heap::promote_atom(const BaseExpressionRef &item) {
+    switch (item->type()) {
+        case MachineIntegerType:
+            if (is_arena_allocated(item.get())) {
+                return MachineInteger(static_cast<const class MachineInteger*>(item.get())->value);
+            }
+            return item;
+
+        case BigIntegerType:
+            if (is_arena_allocated(item.get())) {
+                return BigInteger(static_cast<const class BigInteger*>(item.get())->value);
+            }
+            return item;
+
+        case MachineRealType:
+            if (is_arena_allocated(item.get())) {
+                return MachineReal(static_cast<const class MachineReal*>(item.get())->value);
+            }
+            return item;
+
+        case BigRealType:
+            if (is_arena_allocated(item.get())) {
+                return BigReal(static_cast<const class BigReal*>(item.get())->_value);
+            }
+            return item;
+
+        case MachineComplexType:
+            if (is_arena_allocated(item.get())) {
+                return MachineComplex(static_cast<const class MachineComplex*>(item.get())->value);
+            }
+            return item;
+
+        case BigComplexType:
+            if (is_arena_allocated(item.get())) {
+                const class BigComplex * const value = static_cast<const class BigComplex*>(item.get());
+                return BigComplex(value->_real, value->_imag);
+            }
+            return item;
+
+        case StringType:
+            if (is_arena_allocated(item.get())) {
+                // the extent a String points into never lives in an Arena.
+                const class String * const string = static_cast<const class String*>(item.get());
+                if (string->extent()) {
+                    return String(string->extent(), string->value);
+                } else {
+                    return String(string->value.to_string());
+                }
+            }
+            return item;
+
+        default:
+            // symbols and rationals are never arena allocated.
+            return item;
+    }
+}
+
+BaseExpressionRef Heap::promote(const BaseExpressionRef &item) {
+    // copies everything that lives in an Arena into the long-lived pools. pooled objects
+    // that do not live in an Arena are returned as they are: they were necessarily created
+    // outside of arena mode and therefore cannot refer to arena objects.
+
+    assert(!instance()._use_arena);
+
+    if (item->type() != ExpressionType || !is_arena_allocated(item.get())) {
+        return promote_atom(item);
+    }
+
+    // explicit stack here, so that deeply nested expressions do not overflow the C stack.
+    std::vector<Promotion> stack;
+    stack.emplace_back(static_cast<const class Expression*>(item.get()));
+
+    while (true) {
+        Promotion &top = stack.back();
+
+        if (top.done()) {
+            BaseExpressionRef promoted = top.finish();
+            stack.pop_back();
+            if (stack.empty()) {
+                return promoted;
+            }
+            stack.back().add(std::move(promoted));
+            continue;
+        }
+
+        BaseExpressionRef next = top.next();
+        if (next->type() == ExpressionType && is_arena_allocated(next.get())) {
+            stack.emplace_back(static_cast<const class Expression*>(next.get())); // invalidates top
+        } else {
+            top.add(promote_atom(next));
+        }
+    }
+}
+
+template<typename F>
+void Heap::for_each_pool(const F &f) const {
+    f("MachineInteger", _machine_integers);
+    f("BigInteger", _big_integers);
+    f("MachineReal", _machine_reals);
+    f("BigReal", _big_reals);
+    f("MachineComplex", _machine_complexes);
+    f("BigComplex", _big_complexes);
+    f("String", _strings);
+    f("Expression0", _expression0);
+    f("Expression1", _expression1);
+    f("Expression2", _expression2);
+    f("Expression3", _expression3);
+    f("RefsExpression", _expression_refs);
+    static const char *refs_block_names[NumberOfRefsBlockClasses] = {
+        "RefsBlock8", "RefsBlock16", "RefsBlock32", "RefsBlock64", "RefsBlock128", "RefsBlock256"};
+    for (size_t k = 0; k < NumberOfRefsBlockClasses; k++) {
+        f(refs_block_names[k], _refs_blocks[k]);
+    }
+    f("PackedMachineIntegers", _expression_machine_integers);
+    f("PackedMachineReals", _expression_machine_reals);
+    f("PackedBigIntegers", _expression_big_integers);
+    f("PackedRationals", _expression_rationals);
+    f("PackedStrings", _expression_strings);
+    f("PackedMachineComplexes", _expression_machine_complexes);
+    f("RopeExpression", _expression_ropes);
+    f("MachineIntegerTensors", _expression_machine_integer_tensors);
+    f("MachineRealTensors", _expression_machine_real_tensors);
+    f("MachineComplexTensors", _expression_machine_complex_tensors);
+    f("RangeExpression", _expression_ranges);
+}
+
+std::vector<AllocationStatistics> Heap::statistics() {
+    std::vector<AllocationStatistics> statistics;
+
+    std::lock_guard<std::mutex> lock(_s_mutex);
+
+    for (const Heap *heap : heaps()) {
+        size_t i = 0;
+        heap->for_each_pool([&statistics, &i] (const char *name, const SlabPool &pool) {
+            if (i == statistics.size()) {
+                statistics.push_back(AllocationStatistics{name, pool.slot_size(), 0, 0, 0, 0});
+            }
+            AllocationStatistics &entry = statistics[i++];
+            entry.live_bytes += pool.live() * pool.slot_size();
+            entry.peak_bytes += pool.peak() * pool.slot_size();
+            entry.reserved_bytes += pool.reserved();
+            entry.allocations += pool.allocations();
+        });
+    }
+
+    AllocationStatistics arena{"Arena", 0, 0, 0, 0, 0};
+    for (const Heap *heap : heaps()) {
+        arena.live_bytes += heap->_arena.in_use();
+        arena.peak_bytes += heap->_arena.peak();
+        arena.reserved_bytes += heap->_arena.reserved();
+        arena.allocations += heap->_arena.allocations();
+    }
+    statistics.push_back(arena);
+
+    const size_t extent_bytes = _s_extent_bytes.load(std::memory_order_relaxed);
+    const size_t extent_peak = _s_extent_peak.load(std::memory_order_relaxed);
+    statistics.push_back(AllocationStatistics{"Extents", 0, extent_bytes, extent_peak, extent_peak,
+        _s_extent_allocations.load(std::memory_order_relaxed)});
+
+    return statistics;
+}
+
+size_t Heap::memory_in_use() {
+    size_t bytes = 0;
+    for (const AllocationStatistics &entry : statistics()) {
+        bytes += entry.live_bytes;
+    }
+    return bytes;
+}
+
+size_t Heap::max_memory_used() {
+    size_t bytes = 0;
+    for (const AllocationStatistics &entry : statistics()) {
+        bytes += entry.reserved_bytes;
+    }
+    return bytes;
+}
+
+namespace {
+    inline size_t mpz_byte_count(const mpz_class &value) {
+        return mpz_size(value.get_mpz_t()) * sizeof(mp_limb_t);
+    }
+
+    template<typename U>
+    inline size_t packed_byte_count(const Expression *expr) {
+        return sizeof(ExpressionImplementation<PackSlice<U>>) + expr->size() * sizeof(U);
+    }
+
+    template<>
+    inline size_t packed_byte_count<std::string>(const Expression *expr) {
+        const auto packed = static_cast<const ExpressionImplementation<PackSlice<std::string>>*>(expr);
+        return sizeof(ExpressionImplementation<PackSlice<std::string>>) + packed->_leaves.byte_count();
+    }
+
+    template<typename U>
+    inline size_t tensor_byte_count(const Expression *expr) {
+        const auto tensor = static_cast<const ExpressionImplementation<TensorSlice<U>>*>(expr);
+        return sizeof(ExpressionImplementation<TensorSlice<U>>) + tensor->_leaves.element_count() * sizeof(U);
+    }
+}
+
+size_t Heap::byte_count(const BaseExpressionRef &item) {
+    // symbols are shared by definition and thus count as 0 bytes. we work through an
+    // explicit stack here, so that deeply nested expressions do not overflow the C stack.
+
+    size_t bytes = 0;
+
+    std::vector<BaseExpressionRef> stack;
+    stack.push_back(item);
+
+    while (!stack.empty()) {
+        const BaseExpressionRef expr = stack.back();
+        stack.pop_back();
+
+        switch (expr->type()) {
+            case MachineIntegerType:
+                bytes += sizeof(class MachineInteger);
+                break;
+
+            case BigIntegerType:
+                bytes += sizeof(class BigInteger) + mpz_byte_count(
+                    static_cast<const class BigInteger*>(expr.get())->value);
+                break;
+
+            case MachineRealType:
+                bytes += sizeof(class MachineReal);
+                break;
+
+            case BigRealType:
+                bytes += sizeof(class BigReal) + (static_cast<const class BigReal*>(
+                    expr.get())->_value.get_prec() + 7) / 8;
+                break;
+
+            case MachineComplexType:
+                bytes += sizeof(class MachineComplex);
+                break;
+
+            case BigComplexType: {
+                const class BigComplex * const value = static_cast<const class BigComplex*>(expr.get());
+                bytes += sizeof(class BigComplex) +
+                    (value->_real.get_prec() + 7) / 8 + (value->_imag.get_prec() + 7) / 8;
+                break;
+            }
+
+            case RationalType: {
+                const mpq_class &value = static_cast<const Rational*>(expr.get())->value;
+                bytes += sizeof(Rational) + mpz_byte_count(value.get_num()) + mpz_byte_count(value.get_den());
+                break;
+            }
+
+            case StringType:
+                bytes += sizeof(class String) + static_cast<const class String*>(expr.get())->value.size();
+                break;
+
+            case ExpressionType: {
+                const class Expression * const expr_ptr = static_cast<const class Expression*>(expr.get());
+                stack.push_back(expr_ptr->_head);
+
+                const SliceTypeId type_id = expr_ptr->slice_type_id();
+                switch (type_id) {
+                    case PackSliceMachineIntegerCode:
+                        bytes += packed_byte_count<machine_integer_t>(expr_ptr);
+                        continue;
+                    case PackSliceMachineRealCode:
+                        bytes += packed_byte_count<machine_real_t>(expr_ptr);
+                        continue;
+                    case PackSliceBigIntegerCode:
+                        bytes += packed_byte_count<mpz_class>(expr_ptr);
+                        continue;
+                    case PackSliceRationalCode:
+                        bytes += packed_byte_count<mpq_class>(expr_ptr);
+                        continue;
+                    case PackSliceStringCode:
+                        bytes += packed_byte_count<std::string>(expr_ptr);
+                        continue;
+                    case PackSliceMachineComplexCode:
+                        bytes += packed_byte_count<machine_complex_t>(expr_ptr);
+                        continue;
+                    case TensorSliceMachineIntegerCode:
+                        bytes += tensor_byte_count<machine_integer_t>(expr_ptr);
+                        continue;
+                    case TensorSliceMachineRealCode:
+                        bytes += tensor_byte_count<machine_real_t>(expr_ptr);
+                        continue;
+                    case TensorSliceMachineComplexCode:
+                        bytes += tensor_byte_count<machine_complex_t>(expr_ptr);
+                        continue;
+                    case RangeSliceCode:
+                        bytes += sizeof(ExpressionImplementation<RangeSlice>); // leaves take no memory
+                        continue;
+                    case RefsSliceCode:
+                        bytes += sizeof(ExpressionImplementation<RefsSlice>) +
+                            RefsExtent::allocation_size(expr_ptr->size());
+                        break;
+                    case InPlaceSlice0Code:
+                        bytes += sizeof(ExpressionImplementation<InPlaceRefsSlice<0>>);
+                        break;
+                    case InPlaceSlice1Code:
+                        bytes += sizeof(ExpressionImplementation<InPlaceRefsSlice<1>>);
+                        break;
+                    case InPlaceSlice2Code:
+                        bytes += sizeof(ExpressionImplementation<InPlaceRefsSlice<2>>);
+                        break;
+                    case InPlaceSlice3Code:
+                        bytes += sizeof(ExpressionImplementation<InPlaceRefsSlice<3>>);
+                        break;
+                    case RopeSliceCode: {
+                        const auto rope = static_cast<const ExpressionImplementation<RopeSlice>*>(expr_ptr);
+                        const RopeSlice &slice = rope->_leaves;
+                        bytes += sizeof(ExpressionImplementation<RopeSlice>);
+                        if (slice.root()) {
+                            bytes += slice.root()->count() * sizeof(RopeNode);
+                        }
+                        if (slice.flat()) {
+                            bytes += RefsExtent::allocation_size(slice.size());
+                        }
+                        // walk the chunks instead of looking up each leaf from the root.
+                        for (auto leaf : rope->leaves()) {
+                            stack.push_back(leaf);
+                        }
+                        continue;
+                    }
+                    default:
+                        throw std::runtime_error("encountered unsupported slice type id");
+                }
+
+                const size_t size = expr_ptr->size();
+                for (size_t i = 0; i < size; i++) {
+                    stack.push_back(expr_ptr->leaf(i));
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    return bytes;
 }
@@ -1,17 +1,34 @@
 #ifndef CMATHICS_HEAP_H
 #define CMATHICS_HEAP_H
 
-#include <boost/pool/object_pool.hpp>
+#include <cstdint>
+#include <utility>
+#include <new>
+#include <limits>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <experimental/string_view>
 #include <mpfrcxx/mpreal.h>
 
 #include "gmpxx.h"
 
+class Heap;
+
 class MachineInteger;
 class BigInteger;
 
 class MachineReal;
 class BigReal;
 
+class MachineComplex;
+class BigComplex;
+
+class String;
+
+class StringExtent;
+
 template<size_t N>
 class InPlaceRefsSlice;
 
@@ -27,28 +44,764 @@ using PackExpressionRef = boost::intrusive_ptr<ExpressionImplementation<PackSlic
 template<size_t N>
 using InPlaceExpressionRef = boost::intrusive_ptr<ExpressionImplementation<InPlaceRefsSlice<N>>>;
 
+class RopeSlice;
+
+typedef boost::intrusive_ptr<ExpressionImplementation<RopeSlice>> RopeExpressionRef;
+
+template<typename U>
+class TensorSlice;
+
+template<typename U>
+using TensorExpressionRef = boost::intrusive_ptr<ExpressionImplementation<TensorSlice<U>>>;
+
+class RangeSlice;
+
+typedef boost::intrusive_ptr<ExpressionImplementation<RangeSlice>> RangeExpressionRef;
+
+// SlabPool is a segregated slab allocator: each pool hands out fixed-size slots for
+// exactly one object type. slots are carved out of pages aligned to PoolPageSize, and
+// every page keeps its own intrusive free list, so that both allocate() and deallocate()
+// are O(1) (boost::object_pool::free keeps its free list ordered, which is linear in the
+// size of the pool).
+
+// pages that have free slots are kept on a stack, i.e. the page that most recently saw a
+// free (and is thus most likely still in cache) is the first one to be reused. pages are
+// never given back to the system before the pool itself goes away.
+
+// a pool belongs to exactly one Heap and is only ever touched by the thread owning that
+// Heap. slots freed by other threads are pushed onto a lock-free remote free list instead
+// (see deallocate_remote()), which the owner drains whenever it runs out of free slots.
+
+constexpr size_t PoolPageSize = 64 * 1024;
+
+class SlabPool;
+class Arena;
+
+// every page handed out by a SlabPool or an Arena starts with a PageHeader, which allows
+// us to find the owner of any pooled object by masking its address.
+
+struct PageHeader {
+    SlabPool *pool; // nullptr for arena chunks
+    Arena *arena; // nullptr for pool pages
+};
+
+inline PageHeader *page_header_of(const void *p) {
+    return reinterpret_cast<PageHeader*>(reinterpret_cast<uintptr_t>(p) & ~uintptr_t(PoolPageSize - 1));
+}
+
+// a Counter is only ever written by the thread owning it, but may be read by any thread
+// (e.g. to report memory statistics). relaxed loads and stores compile to plain moves, so
+// counting is (nearly) free.
+
+class Counter {
+private:
+    std::atomic<size_t> _value;
+
+public:
+    inline Counter() : _value(0) {
+    }
+
+    inline size_t get() const {
+        return _value.load(std::memory_order_relaxed);
+    }
+
+    inline void set(size_t value) {
+        _value.store(value, std::memory_order_relaxed);
+    }
+
+    inline void add(size_t n) {
+        set(get() + n);
+    }
+
+    inline void sub(size_t n) {
+        set(get() - n);
+    }
+
+    inline void add_tracking_peak(size_t n, Counter &peak) {
+        const size_t value = get() + n;
+        set(value);
+        if (value > peak.get()) {
+            peak.set(value);
+        }
+    }
+};
+
+class SlabPool {
+private:
+    struct Slot {
+        Slot *next;
+    };
+
+    struct Page : public PageHeader {
+        Page *next_page; // all pages of this pool
+        Page *next_free_page; // pages on the free page stack
+        Slot *free;
+        size_t used;
+        bool stacked;
+    };
+
+    Heap * const _heap;
+
+    const size_t _slot_size;
+    const size_t _slot_offset;
+
+    Page *_pages;
+    Page *_free_pages;
+    Page *_current;
+
+    std::atomic<Slot*> _remote_free;
+    std::atomic<size_t> _remote_frees; // number of slots in _remote_free
+
+    Counter _live;
+    Counter _peak;
+    Counter _allocations;
+    Counter _reserved_pages;
+
+    static inline Page *page_of(void *p) {
+        return static_cast<Page*>(page_header_of(p));
+    }
+
+    Page *next_page();
+
+    void drain_remote();
+
+public:
+    SlabPool(Heap *heap, size_t size, size_t align);
+
+    SlabPool(const SlabPool&) = delete;
+
+    ~SlabPool();
+
+    inline void *allocate() {
+        Page *page = _current;
+        if (!page || !page->free) {
+            page = next_page();
+        }
+        Slot * const slot = page->free;
+        page->free = slot->next;
+        page->used++;
+        _live.add_tracking_peak(1, _peak);
+        _allocations.add(1);
+        return slot;
+    }
+
+    inline void deallocate(void *p) {
+        Page * const page = page_of(p);
+        Slot * const slot = static_cast<Slot*>(p);
+        slot->next = page->free;
+        page->free = slot;
+        page->used--;
+        _live.sub(1);
+        if (!page->stacked && page != _current) {
+            page->next_free_page = _free_pages;
+            page->stacked = true;
+            _free_pages = page;
+        }
+    }
+
+    inline void deallocate_remote(void *p) {
+        // may be called from any thread. as the owner always takes the whole list at once
+        // (see drain_remote()), there is no ABA problem here.
+        Slot * const slot = static_cast<Slot*>(p);
+        _remote_frees.fetch_add(1, std::memory_order_relaxed); // before the owner can see it
+        slot->next = _remote_free.load(std::memory_order_relaxed);
+        while (!_remote_free.compare_exchange_weak(
+            slot->next, slot, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
+
+    inline Heap *heap() const {
+        return _heap;
+    }
+
+    // statistics. slots freed by other threads count as free right away, not only once
+    // they got drained.
+
+    inline size_t slot_size() const {
+        return _slot_size;
+    }
+
+    inline size_t live() const {
+        const size_t live = _live.get();
+        const size_t remote = _remote_frees.load(std::memory_order_relaxed);
+        return live > remote ? live - remote : 0; // the two might be read mid-drain
+    }
+
+    inline size_t peak() const {
+        return _peak.get();
+    }
+
+    inline size_t allocations() const {
+        return _allocations.get();
+    }
+
+    inline size_t reserved() const {
+        return _reserved_pages.get() * PoolPageSize;
+    }
+};
+
+template<typename T>
+class ObjectPool : public SlabPool {
+public:
+    inline ObjectPool(Heap *heap = nullptr) : SlabPool(heap, sizeof(T), alignof(T)) {
+    }
+
+    template<typename... Args>
+    inline T *construct(Args&&... args) {
+        void * const p = allocate();
+        try {
+            return new(p) T(std::forward<Args>(args)...);
+        } catch(...) {
+            deallocate(p);
+            throw;
+        }
+    }
+
+    inline void free(T *p) {
+        p->~T();
+        deallocate(p);
+    }
+};
+
+// small machine integers are immediates: they live in one static table that is set up
+// on first use (which might happen during static initialization) and never goes away. from_primitive() hands them out without allocating,
+// and they are immortal, i.e. reference counting skips them (which also makes immediates
+// safe to share between threads).
+
+// the range of immediate integers is configured at build time (see CMakeLists.txt).
+
+#ifndef CMATHICS_MIN_IMMEDIATE_INTEGER
+#define CMATHICS_MIN_IMMEDIATE_INTEGER -1024
+#endif
+
+#ifndef CMATHICS_MAX_IMMEDIATE_INTEGER
+#define CMATHICS_MAX_IMMEDIATE_INTEGER 1024
+#endif
+
+class Immediates {
+public:
+    static constexpr machine_integer_t MinInteger = CMATHICS_MIN_IMMEDIATE_INTEGER;
+    static constexpr machine_integer_t MaxInteger = CMATHICS_MAX_IMMEDIATE_INTEGER;
+
+    static_assert(MinInteger <= 0 && MaxInteger >= 1, "immediate integers must include 0 and 1");
+
+    static constexpr size_t NumberOfIntegers = size_t(MaxInteger - MinInteger + 1);
+
+    static constexpr size_t SlotSize = 32; // >= sizeof(MachineInteger), checked in heap.cpp
+
+private:
+    alignas(16) static char _s_integers[NumberOfIntegers * SlotSize];
+
+    static bool init();
+
+    // the table, set up by the first caller.
+    static inline const char *integers() {
+        static const bool initialized = init();
+        (void)initialized;
+        return _s_integers;
+    }
+
+public:
+    static inline bool contains(const BaseExpression *expr) {
+        return uintptr_t(expr) - uintptr_t(_s_integers) < sizeof(_s_integers);
+    }
+
+    static inline bool is_integer(machine_integer_t value) {
+        return value >= MinInteger && value <= MaxInteger;
+    }
+
+    static inline const BaseExpression *integer(machine_integer_t value) {
+        return reinterpret_cast<const BaseExpression*>(integers() + (value - MinInteger) * SlotSize);
+    }
+};
+
+// every thread gets its own Heap, which is created on first use (or through init()) and
+// which needs no locking. objects may be released on any thread: if that is not the thread
+// that allocated them, their slots travel back to the owning Heap through the lock-free
+// remote free lists of its pools. note that reference counts are not atomic, i.e. an
+// object may be handed over to another thread, but it must not be shared between threads
+// that concurrently add or drop references to it.
+
+// a Heap outlives its thread (objects allocated from it might still be alive elsewhere).
+// when a thread exits, its Heap gets abandoned and is adopted by the next new thread.
+
+// an Arena bump-allocates objects of any (pooled) type into chunks of PoolPageSize bytes.
+// freeing an arena object only decrements the live count of its chunk; as soon as a chunk
+// holds no more live objects, it gets reused as a whole. this makes releasing temporaries
+// nearly free, and it stays safe if some stale reference keeps an object alive for longer
+// (its chunk simply does not get reused until then).
+
+// an Arena belongs to a Heap and its objects must not be released on other threads.
+
+class Arena {
+private:
+    struct Chunk : public PageHeader {
+        Chunk *next_free_chunk;
+        char *top;
+        size_t live;
+    };
+
+    static constexpr size_t Alignment = 16;
+
+    Heap * const _heap;
+
+    Chunk *_current;
+    Chunk *_free_chunks;
+
+    Counter _chunks_in_use;
+    Counter _peak_chunks;
+    Counter _allocations;
+    Counter _reserved_chunks;
+
+    static constexpr size_t chunk_offset() {
+        return (sizeof(Chunk) + Alignment - 1) & ~(Alignment - 1);
+    }
+
+    Chunk *next_chunk(size_t size);
+
+    inline void recycle(Chunk *chunk) {
+        chunk->top = reinterpret_cast<char*>(chunk) + chunk_offset();
+        if (chunk != _current) {
+            chunk->next_free_chunk = _free_chunks;
+            _free_chunks = chunk;
+            _chunks_in_use.sub(1);
+        }
+    }
+
+public:
+    Arena(Heap *heap);
+
+    Arena(const Arena&) = delete;
+
+    inline void *allocate(size_t size) {
+        size = (size + Alignment - 1) & ~(Alignment - 1);
+        Chunk *chunk = _current;
+        if (!chunk || chunk->top + size > reinterpret_cast<char*>(chunk) + PoolPageSize) {
+            chunk = next_chunk(size);
+        }
+        void * const p = chunk->top;
+        chunk->top += size;
+        chunk->live++;
+        _allocations.add(1);
+        return p;
+    }
+
+    static inline void deallocate(void *p) {
+        Chunk * const chunk = static_cast<Chunk*>(page_header_of(p));
+        if (--chunk->live == 0) {
+            chunk->arena->recycle(chunk);
+        }
+    }
+
+    template<typename T, typename... Args>
+    inline T *construct(Args&&... args) {
+        void * const p = allocate(sizeof(T));
+        try {
+            return new(p) T(std::forward<Args>(args)...);
+        } catch(...) {
+            deallocate(p);
+            throw;
+        }
+    }
+
+    inline Heap *heap() const {
+        return _heap;
+    }
+
+    // statistics, in bytes (the granularity is one chunk).
+
+    inline size_t in_use() const {
+        return _chunks_in_use.get() * PoolPageSize;
+    }
+
+    inline size_t peak() const {
+        return _peak_chunks.get() * PoolPageSize;
+    }
+
+    inline size_t allocations() const {
+        return _allocations.get();
+    }
+
+    inline size_t reserved() const {
+        return _reserved_chunks.get() * PoolPageSize;
+    }
+};
+
+// releasing an object does not recurse into the objects it refers to. instead, everything
+// that drops to a reference count of 0 gets queued on a per-thread release list (linked
+// through the now unused reference count fields) and is then freed iteratively. this keeps
+// the stack depth bounded, even for very deeply nested expressions.
+
+// in deferred mode (see DeferredRelease), the list is only drained once it holds a batch
+// of ReleaseBatchSize objects, and finally when the mode ends.
+
+// memory statistics for one kind of object, summed over all Heaps. object_size is 0 for
+// kinds of varying size.
+
+struct AllocationStatistics {
+    const char *name;
+    size_t object_size;
+    size_t live_bytes;
+    size_t peak_bytes;
+    size_t reserved_bytes;
+    size_t allocations;
+};
+
+// an allocation (or, if not alive, a free) seen by an ImmortalScope.
+
+struct ImmortalEvent {
+    BaseExpression *expr;
+    bool alive;
+};
+
+struct ReleaseList {
+    BaseExpression *head;
+    size_t size;
+    bool draining;
+    bool deferred;
+};
+
+// thrown by an allocation that would exceed the current thread's memory budget.
+
+class MemoryLimitExceeded : public std::bad_alloc {
+public:
+    virtual const char *what() const noexcept {
+        return "memory limit exceeded";
+    }
+};
+
+// bytes held by objects allocated on the current thread since its budget started (less
+// the bytes of objects freed on it), see MemoryBudget.
+
+struct MemoryBudgetState {
+    size_t used;
+    size_t limit;
+};
+
+// an InternTable holds weak references to interned objects, i.e. it does not keep them
+// alive. objects get erased from it as soon as they are released (not only once they are
+// freed, see DeferredRelease). collisions are resolved through linear probing, and erase()
+// shifts entries back instead of leaving tombstones.
+
+class InternTable {
+private:
+    struct Entry {
+        hash_t hash;
+        BaseExpression *expr; // nullptr if empty
+    };
+
+    std::vector<Entry> _entries; // empty, or a power of two in size
+    size_t _size;
+
+    void grow();
+
+public:
+    inline InternTable() : _size(0) {
+    }
+
+    InternTable(const InternTable&) = delete;
+
+    // returns the object with the given hash for which equals() holds, or nullptr.
+    template<typename F>
+    inline BaseExpression *find(hash_t hash, const F &equals) const {
+        if (_size == 0) {
+            return nullptr;
+        }
+        const size_t mask = _entries.size() - 1;
+        for (size_t i = hash & mask; _entries[i].expr; i = (i + 1) & mask) {
+            const Entry &entry = _entries[i];
+            if (entry.hash == hash && equals(*entry.expr)) {
+                return entry.expr;
+            }
+        }
+        return nullptr;
+    }
+
+    void insert(hash_t hash, BaseExpression *expr);
+
+    void erase(hash_t hash, const BaseExpression *expr);
+
+    inline size_t size() const {
+        return _size;
+    }
+};
+
 class Heap {
 private:
-    static Heap *_s_instance;
+    static thread_local Heap *_s_instance;
+
+    static thread_local ReleaseList _s_release_list;
+
+    static thread_local MemoryBudgetState _s_budget;
+
+    static thread_local std::vector<ImmortalEvent> *_s_immortal_log; // see ImmortalScope
+
+    // Heaps get created on first use, which might happen during static initialization. so
+    // everything here is either constant initialized or a function-local static.
+
+    static std::mutex _s_mutex; // guards heaps() and abandoned_heaps()
+
+    static std::vector<Heap*> &heaps();
+    static std::vector<Heap*> &abandoned_heaps();
+
+    // the Heap for each intern id (minus 1), which owns the objects interned with that id.
+    static std::atomic<Heap*> _s_interning_heaps[255];
+
+    // PackExtents and stand-alone RefsExtents get allocated and freed on any thread.
+    static std::atomic<size_t> _s_extent_bytes;
+    static std::atomic<size_t> _s_extent_peak;
+    static std::atomic<size_t> _s_extent_allocations;
+
+    ObjectPool<MachineInteger> _machine_integers;
+    ObjectPool<BigInteger> _big_integers;
+
+    ObjectPool<MachineReal> _machine_reals;
+    ObjectPool<BigReal> _big_reals;
+
+    ObjectPool<MachineComplex> _machine_complexes;
+    ObjectPool<BigComplex> _big_complexes;
+
+    ObjectPool<String> _strings;
+
+    ObjectPool<ExpressionImplementation<InPlaceRefsSlice<0>>> _expression0;
+    ObjectPool<ExpressionImplementation<InPlaceRefsSlice<1>>> _expression1;
+    ObjectPool<ExpressionImplementation<InPlaceRefsSlice<2>>> _expression2;
+    ObjectPool<ExpressionImplementation<InPlaceRefsSlice<3>>> _expression3;
 
-    boost::object_pool<MachineInteger> _machine_integers;
-    boost::object_pool<BigInteger> _big_integers;
+    ObjectPool<ExpressionImplementation<RefsSlice>> _expression_refs;
 
-    boost::object_pool<MachineReal> _machine_reals;
-    boost::object_pool<BigReal> _big_reals;
+    // blocks that hold a RefsSlice expression together with its RefsExtent, for up to
+    // 8, 16, ..., 256 leaves (see refs_block_class()).
+    static constexpr size_t NumberOfRefsBlockClasses = 6;
+    SlabPool _refs_blocks[NumberOfRefsBlockClasses];
 
-    boost::object_pool<ExpressionImplementation<InPlaceRefsSlice<0>>> _expression0;
-    boost::object_pool<ExpressionImplementation<InPlaceRefsSlice<1>>> _expression1;
-    boost::object_pool<ExpressionImplementation<InPlaceRefsSlice<2>>> _expression2;
-    boost::object_pool<ExpressionImplementation<InPlaceRefsSlice<3>>> _expression3;
+    ObjectPool<ExpressionImplementation<PackSlice<machine_integer_t>>> _expression_machine_integers;
+    ObjectPool<ExpressionImplementation<PackSlice<machine_real_t>>> _expression_machine_reals;
+    ObjectPool<ExpressionImplementation<PackSlice<mpz_class>>> _expression_big_integers;
+    ObjectPool<ExpressionImplementation<PackSlice<mpq_class>>> _expression_rationals;
+    ObjectPool<ExpressionImplementation<PackSlice<std::string>>> _expression_strings;
+    ObjectPool<ExpressionImplementation<PackSlice<machine_complex_t>>> _expression_machine_complexes;
 
-    boost::object_pool<ExpressionImplementation<RefsSlice>> _expression_refs;
+    ObjectPool<ExpressionImplementation<RopeSlice>> _expression_ropes;
+
+    ObjectPool<ExpressionImplementation<TensorSlice<machine_integer_t>>> _expression_machine_integer_tensors;
+    ObjectPool<ExpressionImplementation<TensorSlice<machine_real_t>>> _expression_machine_real_tensors;
+    ObjectPool<ExpressionImplementation<TensorSlice<machine_complex_t>>> _expression_machine_complex_tensors;
+
+    ObjectPool<ExpressionImplementation<RangeSlice>> _expression_ranges;
+
+    Arena _arena;
+    bool _use_arena;
+
+    InternTable _intern_table;
+    const uint8_t _intern_id; // 0 if this Heap cannot intern
+    bool _interning;
+
+    // objects from _intern_table released on other threads, linked through their reference
+    // count fields. the owner erases and frees them, see collect_interned().
+    std::atomic<BaseExpression*> _remote_interned;
+
+    friend class ArenaScope;
+    friend class Interning;
+    friend class ImmortalScope;
+    friend class DeferredRelease;
+    friend class MemoryBudget;
+
+    Heap(uint8_t intern_id);
+
+    static void free(BaseExpression *expr);
+
+    static void drain();
+
+    // promotes anything but an arena expression, see promote().
+    static BaseExpressionRef promote_atom(const BaseExpressionRef &item);
+
+    template<typename F>
+    void for_each_pool(const F &f) const;
+
+    static inline Heap &instance() {
+        Heap * const heap = _s_instance;
+        return heap ? *heap : *init();
+    }
+
+    static inline void log_immortal(BaseExpression *expr, bool alive) {
+        std::vector<ImmortalEvent> * const log = _s_immortal_log;
+        if (log) {
+            log->push_back(ImmortalEvent{expr, alive});
+        }
+    }
+
+    template<typename T, typename... Args>
+    inline T *construct(ObjectPool<T> &pool, Args&&... args) {
+        charge(sizeof(T));
+        T *expr;
+        try {
+            if (_use_arena) {
+                expr = _arena.construct<T>(std::forward<Args>(args)...);
+            } else {
+                expr = pool.construct(std::forward<Args>(args)...);
+            }
+        } catch(...) {
+            credit(sizeof(T));
+            throw;
+        }
+        log_immortal(expr, true);
+        return expr;
+    }
+
+    // arena objects are never interned, as promote() needs to copy them.
+    inline bool interns() const {
+        return _interning && !_use_arena;
+    }
+
+    ExpressionRef intern_expression(const ExpressionRef &expr);
+
+    inline void release_interned_remote(BaseExpression *expr) {
+        // may be called from any thread, see SlabPool::deallocate_remote().
+        BaseExpression *head = _remote_interned.load(std::memory_order_relaxed);
+        do {
+            expr->_ref_count = reinterpret_cast<size_t>(head);
+        } while (!_remote_interned.compare_exchange_weak(
+            head, expr, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    void drain_interned_remote();
+
+    // objects released on other threads must not be found in the intern table anymore.
+    inline void collect_interned() {
+        if (_remote_interned.load(std::memory_order_relaxed)) {
+            drain_interned_remote();
+        }
+    }
+
+    // the object equal to the one that args would construct, if there is one in the intern
+    // table, otherwise a newly constructed (and interned) one.
+    template<typename T, typename F, typename... Args>
+    inline T *construct_interned(ObjectPool<T> &pool, hash_t hash, const F &equals, Args&&... args) {
+        collect_interned();
+        BaseExpression * const found = _intern_table.find(hash, equals);
+        if (found) {
+            return static_cast<T*>(found);
+        }
+        T * const expr = construct(pool, std::forward<Args>(args)...);
+        _intern_table.insert(hash, expr);
+        static_cast<BaseExpression*>(expr)->_interned = _intern_id;
+        return expr;
+    }
+
+    template<size_t N>
+    InPlaceExpressionRef<N> in_place_expression(
+        ObjectPool<ExpressionImplementation<InPlaceRefsSlice<N>>> &pool,
+        const BaseExpressionRef &head,
+        const InPlaceRefsSlice<N> &slice);
+
+    template<typename T>
+    static inline void destroy(T *p) {
+        p->~T();
+        deallocate(p);
+        credit(sizeof(T));
+    }
 
 public:
-    static void init();
+    // gives back memory obtained from any pool or arena of any Heap.
+    static inline void deallocate(void *p) {
+        const PageHeader * const page = page_header_of(p);
+        SlabPool * const pool = page->pool;
+        if (!pool) {
+            assert(page->arena->heap() == _s_instance);
+            Arena::deallocate(p);
+        } else if (pool->heap() == _s_instance) {
+            pool->deallocate(p);
+        } else {
+            pool->deallocate_remote(p);
+        }
+    }
+
+    static Heap *init();
+
+    static void abandon(Heap *heap);
+
+    static constexpr size_t ReleaseBatchSize = 4096;
 
     static void release(BaseExpression *expr);
 
+    static inline size_t pending_releases() {
+        return _s_release_list.size;
+    }
+
+    static bool is_arena_allocated(const BaseExpression *expr);
+
+    // accounts for size bytes about to be allocated on the current thread. throws
+    // MemoryLimitExceeded if this would exceed the thread's budget.
+    static inline void charge(size_t size) {
+        MemoryBudgetState &budget = _s_budget;
+        if (size > budget.limit - budget.used) {
+            throw MemoryLimitExceeded();
+        }
+        budget.used += size;
+    }
+
+    static inline void credit(size_t size) {
+        MemoryBudgetState &budget = _s_budget;
+        budget.used -= std::min(size, budget.used); // objects might predate the budget
+    }
+
+    // throws MemoryLimitExceeded if size more bytes would exceed the current thread's
+    // budget, without accounting for them. for memory not allocated through a Heap.
+    static inline void ensure_available(size_t size) {
+        const MemoryBudgetState &budget = _s_budget;
+        if (size > budget.limit - budget.used) {
+            throw MemoryLimitExceeded();
+        }
+    }
+
+    // extents are charged before they get allocated, so a failing extent_allocated()
+    // leaves nothing behind.
+    static inline void extent_allocated(size_t size) {
+        charge(size);
+        const size_t bytes = _s_extent_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+        _s_extent_allocations.fetch_add(1, std::memory_order_relaxed);
+        if (bytes > _s_extent_peak.load(std::memory_order_relaxed)) {
+            _s_extent_peak.store(bytes, std::memory_order_relaxed); // might miss a peak under contention
+        }
+    }
+
+    static inline void extent_freed(size_t size) {
+        _s_extent_bytes.fetch_sub(size, std::memory_order_relaxed);
+        credit(size);
+    }
+
+    // statistics over all Heaps of all threads. objects allocated through other means than
+    // a Heap (e.g. symbols) are not accounted for.
+
+    static std::vector<AllocationStatistics> statistics();
+
+    static size_t memory_in_use();
+
+    // pages are never given back to the system, so the memory reserved by all pools and
+    // arenas is the high-water mark of their usage.
+    static size_t max_memory_used();
+
+    // the number of bytes needed to store expr, counting shared subexpressions each time.
+    static size_t byte_count(const BaseExpressionRef &expr);
+
+    static BaseExpressionRef promote(const BaseExpressionRef &expr);
+
+    // while interning, returns the interned expression that is the same as expr, which needs
+    // to be an expression with up to 3 leaves that nobody else references yet. for leaves
+    // that were filled in after construction (see direct_storage).
+    static inline ExpressionRef intern(const ExpressionRef &expr) {
+        Heap &heap = instance();
+        return heap.interns() ? heap.intern_expression(expr) : expr;
+    }
+
+    // the number of objects in the current thread's intern table.
+    static size_t interned_count();
+
+    // from now on, expr is never freed and its reference count never changes. caches of
+    // expressions are filled, so that their memory does not get written to later on.
+    static void make_immortal(const BaseExpression *expr);
+
     static BaseExpressionRef MachineInteger(machine_integer_t value);
     static BaseExpressionRef BigInteger(const mpz_class &value);
 
@@ -56,6 +809,13 @@ public:
     static BaseExpressionRef BigReal(const mpfr::mpreal &value);
     static BaseExpressionRef BigReal(double prec, machine_real_t value);
 
+    static BaseExpressionRef MachineComplex(const machine_complex_t &value);
+    static BaseExpressionRef BigComplex(const mpfr::mpreal &real, const mpfr::mpreal &imag);
+
+    static BaseExpressionRef String(const std::string &value);
+    static BaseExpressionRef String(
+        const boost::intrusive_ptr<StringExtent> &extent, const std::experimental::string_view &value);
+
 	static InPlaceExpressionRef<0> EmptyExpression0(const BaseExpressionRef &head);
 	static InPlaceExpressionRef<1> EmptyExpression1(const BaseExpressionRef &head);
 	static InPlaceExpressionRef<2> EmptyExpression2(const BaseExpressionRef &head);
@@ -68,14 +828,150 @@ public:
 
     static RefsExpressionRef Expression(const BaseExpressionRef &head, const RefsSlice &slice);
 
-    template<typename U>
-    static PackExpressionRef<U> Expression(const BaseExpressionRef &head, const PackSlice<U> &slice) {
-        return PackExpressionRef<U>(new ExpressionImplementation<PackSlice<U>>(head, slice));
+    static RefsExpressionRef Expression(
+        const BaseExpressionRef &head, std::vector<BaseExpressionRef> &&leaves, OptionalTypeMask type_mask);
+
+    static PackExpressionRef<machine_integer_t> Expression(
+        const BaseExpressionRef &head, const PackSlice<machine_integer_t> &slice);
+    static PackExpressionRef<machine_real_t> Expression(
+        const BaseExpressionRef &head, const PackSlice<machine_real_t> &slice);
+    static PackExpressionRef<mpz_class> Expression(
+        const BaseExpressionRef &head, const PackSlice<mpz_class> &slice);
+    static PackExpressionRef<mpq_class> Expression(
+        const BaseExpressionRef &head, const PackSlice<mpq_class> &slice);
+    static PackExpressionRef<std::string> Expression(
+        const BaseExpressionRef &head, const PackSlice<std::string> &slice);
+    static PackExpressionRef<machine_complex_t> Expression(
+        const BaseExpressionRef &head, const PackSlice<machine_complex_t> &slice);
+
+    static RopeExpressionRef Expression(const BaseExpressionRef &head, const RopeSlice &slice);
+
+    static TensorExpressionRef<machine_integer_t> Expression(
+        const BaseExpressionRef &head, const TensorSlice<machine_integer_t> &slice);
+    static TensorExpressionRef<machine_real_t> Expression(
+        const BaseExpressionRef &head, const TensorSlice<machine_real_t> &slice);
+    static TensorExpressionRef<machine_complex_t> Expression(
+        const BaseExpressionRef &head, const TensorSlice<machine_complex_t> &slice);
+
+    static RangeExpressionRef Expression(const BaseExpressionRef &head, const RangeSlice &slice);
+};
+
+// while an ArenaScope is active, the current thread's Heap allocates pooled objects from
+// its Arena. results that outlive the scope need to go through Heap::promote().
+
+class ArenaScope {
+private:
+    Heap &_heap;
+    const bool _saved;
+
+public:
+    inline ArenaScope(bool use_arena = true) : _heap(Heap::instance()), _saved(_heap._use_arena) {
+        _heap._use_arena = use_arena;
+    }
+
+    inline ~ArenaScope() {
+        _heap._use_arena = _saved;
+    }
+};
+
+// while a DeferredRelease is active, objects released on the current thread are freed in
+// batches. whatever is still pending gets freed when the scope ends.
+
+class DeferredRelease {
+private:
+    const bool _saved;
+
+public:
+    inline DeferredRelease(bool deferred = true) : _saved(Heap::_s_release_list.deferred) {
+        Heap::_s_release_list.deferred = deferred;
+    }
+
+    inline ~DeferredRelease() {
+        Heap::_s_release_list.deferred = _saved;
+        if (!_saved) {
+            Heap::drain();
+        }
     }
 };
 
+// while a MemoryBudget is active, objects allocated on the current thread may hold at most
+// limit bytes (0 means no limit other than that of an enclosing budget). allocations beyond
+// that throw MemoryLimitExceeded. whatever is still held when the scope ends counts against
+// the enclosing budget.
+
+class MemoryBudget {
+private:
+    const MemoryBudgetState _saved;
+
+public:
+    inline MemoryBudget(size_t limit) : _saved(Heap::_s_budget) {
+        const size_t available = _saved.limit - _saved.used;
+        Heap::_s_budget.used = 0;
+        Heap::_s_budget.limit = limit ? std::min(limit, available) : available;
+    }
+
+    inline ~MemoryBudget() {
+        const size_t used = Heap::_s_budget.used;
+        Heap::_s_budget = _saved;
+        Heap::_s_budget.used = std::min(_saved.used + used, _saved.limit);
+    }
+
+    static inline size_t used() {
+        return Heap::_s_budget.used;
+    }
+};
+
+// while an Interning scope is active, the current thread's Heap hands out one shared object
+// for equal atoms (other than symbols, complex and big real numbers) and for equal expressions
+// of up to 3 leaves, so that same() turns into a pointer comparison for them. objects stay
+// interned after the scope ends, until they are freed. objects allocated in an Arena never
+// get interned. an interned object released on another thread goes back to the Heap that
+// interned it, which erases it from its intern table before its next lookup. as for all
+// objects, references to it must not be added or dropped on two threads at the same time,
+// which also means that the interning thread must not look up an object it handed over.
+
+// interning takes one id of at most 255, so Heaps beyond that never intern.
+
+class Interning {
+private:
+    Heap &_heap;
+    const bool _saved;
+
+public:
+    inline Interning(bool interning = true) : _heap(Heap::instance()), _saved(_heap._interning) {
+        _heap._interning = interning && _heap._intern_id != 0;
+    }
+
+    inline ~Interning() {
+        _heap._interning = _saved;
+    }
+};
+
+// objects allocated through the current thread's Heap while an ImmortalScope is active,
+// and which are still alive when it ends, become immortal. this is meant for everything that
+// gets set up once before a process forks its workers (see Runtime::initialize()), so that
+// the workers keep sharing those pages instead of copying them on the first reference count
+// change. objects allocated otherwise (e.g. symbols) need to go through Heap::make_immortal().
+
+class ImmortalScope {
+private:
+    std::vector<ImmortalEvent> _log;
+    std::vector<ImmortalEvent> * const _saved;
+
+public:
+    ImmortalScope();
+
+    ImmortalScope(const ImmortalScope&) = delete;
+
+    ~ImmortalScope();
+};
+
 inline BaseExpressionRef from_primitive(machine_integer_t value) {
-    return BaseExpressionRef(Heap::MachineInteger(value));
+    if (Immediates::is_integer(value)) {
+        return BaseExpressionRef(Immediates::integer(value));
+    } else {
+        return Heap::MachineInteger(value);
+    }
 }
 
 inline BaseExpressionRef from_primitive(const mpz_class &value) {
@@ -7,6 +7,12 @@
 #include "types.h"
 #include "hash.h"
 
+// hashes sign and limbs, i.e. the value, but not how much memory GMP reserved for it.
+inline hash_t hash_mpz(uint64_t seed, const mpz_class &x) {
+	const mpz_srcptr z = x.get_mpz_t();
+	return hash_bytes(seed ^ uint64_t(mpz_sgn(z) + 1), mpz_limbs_read(z), mpz_size(z) * sizeof(mp_limb_t));
+}
+
 class Integer : public BaseExpression {
 public:
 	inline Integer(Type type) : BaseExpression(type) {
@@ -30,7 +36,7 @@ public:
     }
 
     virtual hash_t hash() const {
-        return hash_pair(machine_integer_hash, value);
+        return hash_machine_integer(value);
     }
 
     virtual std::string fullform() const {
@@ -58,8 +64,7 @@ public:
     }
 
     virtual hash_t hash() const {
-        //  TODO hash
-        return 0;
+        return hash_mpz(big_integer_hash, value);
     }
 
     virtual std::string fullform() const {
@@ -11,13 +11,15 @@
 #include <assert.h>
 #include <climits>
 #include <vector>
+#include <memory>
+#include <iterator>
+#include <type_traits>
 #include <experimental/optional>
 
 #include "primitives.h"
 #include "string.h"
 #include "promote.h"
-
-typedef std::experimental::optional<TypeMask> OptionalTypeMask;
+#include "mapped.h"
 
 template<typename T>
 inline TypeMask calc_type_mask(const T &container) {
@@ -163,6 +165,103 @@ public:
 	}
 };
 
+// iterates over a slice through its operator[].
+
+template<typename Slice, typename TypeConverter>
+class IndexedIterator {
+private:
+	const TypeConverter _converter;
+	const Slice *_slice;
+	size_t _index;
+
+public:
+	inline IndexedIterator(const TypeConverter &converter, const Slice *slice, size_t index) :
+		_converter(converter), _slice(slice), _index(index) {
+	}
+
+	inline auto operator*() const {
+		return _converter.convert((*_slice)[_index]);
+	}
+
+	inline bool operator==(const IndexedIterator<Slice, TypeConverter> &other) const {
+		return _index == other._index;
+	}
+
+	inline bool operator!=(const IndexedIterator<Slice, TypeConverter> &other) const {
+		return _index != other._index;
+	}
+
+	inline IndexedIterator<Slice, TypeConverter> &operator++() {
+		_index++;
+		return *this;
+	}
+};
+
+template<typename Slice, typename TypeConverter>
+class IndexedCollection {
+private:
+	const TypeConverter _converter;
+	const Slice * const _slice;
+
+public:
+	using Iterator = IndexedIterator<Slice, TypeConverter>;
+
+	inline IndexedCollection(const Slice *slice, const TypeConverter &converter) :
+		_converter(converter), _slice(slice) {
+	}
+
+	inline Iterator begin() const {
+		return Iterator(_converter, _slice, 0);
+	}
+
+	inline Iterator end() const {
+		return Iterator(_converter, _slice, _slice->size());
+	}
+};
+
+// with_atom(x, f) calls f with an atom for the primitive x that only lives on the stack
+// while f runs, so that borrowing a packed leaf does not allocate. it is the same atom that
+// from_primitive(x) would give, but f gets it as a const BaseExpression &, and must not keep
+// it or turn it into a ref.
+
+template<typename F>
+inline auto with_atom(machine_integer_t x, const F &f) {
+	if (Immediates::is_integer(x)) {
+		return f(*Immediates::integer(x));
+	} else {
+		const MachineInteger atom(x);
+		return f(static_cast<const BaseExpression&>(atom));
+	}
+}
+
+template<typename F>
+inline auto with_atom(machine_real_t x, const F &f) {
+	const MachineReal atom(x);
+	return f(static_cast<const BaseExpression&>(atom));
+}
+
+template<typename F>
+inline auto with_atom(const machine_complex_t &x, const F &f) {
+	const MachineComplex atom(x);
+	return f(static_cast<const BaseExpression&>(atom));
+}
+
+template<typename F>
+inline auto with_atom(const mpz_class &x, const F &f) {
+	if (x.fits_slong_p()) {
+		return with_atom(static_cast<machine_integer_t>(x.get_si()), f);
+	} else {
+		const BigInteger atom(x); // copies the limbs, but no expression gets allocated
+		return f(static_cast<const BaseExpression&>(atom));
+	}
+}
+
+template<typename F>
+inline auto with_atom(const mpq_class &x, const F &f) {
+	const Rational atom(x);
+	return f(static_cast<const BaseExpression&>(atom));
+}
+
 template<typename Size, SliceTypeId _type_id>
 class Slice {
 protected:
@@ -184,30 +283,136 @@ public:
 	}*/
 };
 
+// a PackExtent stores its elements inline, right behind its header, so that the reference
+// count, the size and the element buffer of a packed slice take one single allocation.
+// alternatively, the elements can be the contents of a read-only file mapping (see map()).
+
 template<typename U>
 class PackExtent {
 private:
-	const std::vector<U> _data;
+	size_t _ref_count;
+	const size_t _size;
+	U * const _data;
+	const size_t _mapped_bytes; // 0 if the elements are stored inline
+
+	static constexpr size_t data_offset() {
+		return (sizeof(PackExtent<U>) + alignof(U) - 1) & ~(alignof(U) - 1);
+	}
+
+	inline U *data() {
+		return _data;
+	}
+
+	inline explicit PackExtent(size_t size) :
+		_ref_count(0),
+		_size(size),
+		_data(reinterpret_cast<U*>(reinterpret_cast<char*>(this) + data_offset())),
+		_mapped_bytes(0) {
+	}
+
+	inline PackExtent(size_t size, const void *mapped, size_t mapped_bytes) :
+		_ref_count(0),
+		_size(size),
+		_data(static_cast<U*>(const_cast<void*>(mapped))),
+		_mapped_bytes(mapped_bytes) {
+	}
+
+	template<typename Iterator>
+	static PackExtent<U> *create(size_t size, Iterator first) {
+		const size_t bytes = data_offset() + size * sizeof(U);
+		Heap::extent_allocated(bytes);
+		void *memory = nullptr;
+		try {
+			memory = ::operator new(bytes);
+			PackExtent<U> * const extent = new(memory) PackExtent<U>(size);
+			std::uninitialized_copy_n(first, size, extent->data());
+			return extent;
+		} catch(...) {
+			::operator delete(memory);
+			Heap::extent_freed(bytes);
+			throw;
+		}
+	}
+
+	static void destroy(PackExtent<U> *extent) {
+		if (extent->_mapped_bytes) {
+			unmap_file(extent->_data, extent->_mapped_bytes);
+			Heap::extent_freed(sizeof(PackExtent<U>));
+			extent->~PackExtent<U>();
+			::operator delete(extent);
+			return;
+		}
+
+		U * const data = extent->data();
+		for (size_t i = 0; i < extent->_size; i++) {
+			data[i].~U();
+		}
+		Heap::extent_freed(data_offset() + extent->_size * sizeof(U));
+		extent->~PackExtent<U>();
+		::operator delete(extent);
+	}
 
 public:
-	typedef std::shared_ptr<PackExtent<U>> Ref;
+	typedef boost::intrusive_ptr<PackExtent<U>> Ref;
 
-	inline explicit PackExtent(const std::vector<U> &data) : _data(data) {
+	static inline Ref construct(const std::vector<U> &data) {
+		return Ref(create(data.size(), data.begin()));
 	}
 
-	inline explicit PackExtent(std::vector<U> &&data) : _data(data) {
+	static inline Ref construct(std::vector<U> &&data) {
+		return Ref(create(data.size(), std::make_move_iterator(data.begin())));
 	}
 
-	inline const std::vector<U> &data() const {
-		return _data;
+	// an extent over the contents of the file at path, which are mapped into memory instead
+	// of being copied. only the header counts as allocated memory; the mapped pages belong
+	// to the page cache and may be shared with other processes. throws std::runtime_error if
+	// the file cannot be mapped, or if its size is not a multiple of sizeof(U).
+	static Ref map(const char *path) {
+		static_assert(std::is_trivially_copyable<U>::value, "cannot map values that are not plain bytes");
+
+		size_t bytes;
+		const void * const mapped = map_file(path, bytes);
+		if (bytes % sizeof(U) != 0) {
+			unmap_file(mapped, bytes);
+			throw std::runtime_error(std::string("size of ") + path + " is not a multiple of " +
+				std::to_string(sizeof(U)) + " bytes");
+		}
+		if (bytes == 0) {
+			return construct(std::vector<U>());
+		}
+
+		Heap::extent_allocated(sizeof(PackExtent<U>));
+		void *memory = nullptr;
+		try {
+			memory = ::operator new(sizeof(PackExtent<U>));
+		} catch(...) {
+			Heap::extent_freed(sizeof(PackExtent<U>));
+			unmap_file(mapped, bytes);
+			throw;
+		}
+		return Ref(new(memory) PackExtent<U>(bytes / sizeof(U), mapped, bytes));
 	}
 
 	inline const U *address() {
-		return &_data[0];
+		return data();
+	}
+
+	inline bool is_mapped() const {
+		return _mapped_bytes != 0;
 	}
 
 	inline size_t size() const {
-		return _data.size();
+		return _size;
+	}
+
+	friend inline void intrusive_ptr_add_ref(PackExtent<U> *extent) {
+		++extent->_ref_count;
+	}
+
+	friend inline void intrusive_ptr_release(PackExtent<U> *extent) {
+		if (--extent->_ref_count == 0) {
+			destroy(extent);
+		}
 	}
 };
 
@@ -240,6 +445,24 @@ struct PackSliceTypeId<std::string> {
 	static const SliceTypeId id = PackSliceStringCode;
 };
 
+template<>
+struct PackSliceTypeId<machine_complex_t> {
+	static const SliceTypeId id = PackSliceMachineComplexCode;
+};
+
+// the types of the leaves a PackSlice<U> hands out.
+
+template<typename U>
+struct PackSliceTypeMask {
+	static constexpr TypeMask mask = MakeTypeMask(TypeFromPrimitive<U>::type);
+};
+
+template<>
+struct PackSliceTypeMask<mpz_class> {
+	// from_primitive() turns values that fit into a machine integer into MachineIntegers.
+	static constexpr TypeMask mask = MakeTypeMask(MachineIntegerType) | MakeTypeMask(BigIntegerType);
+};
+
 template<typename U>
 class PackSlice : public Slice<size_t, PackSliceTypeId<U>::id> {
 private:
@@ -256,15 +479,15 @@ public:
 
 public:
 	inline PackSlice(const std::vector<U> &data) :
-		_extent(std::make_shared<PackExtent<U>>(data)),
+		_extent(PackExtent<U>::construct(data)),
 		_begin(_extent->address()),
 		BaseSlice(data.size()) {
 	}
 
 	inline PackSlice(std::vector<U> &&data) :
-		_extent(std::make_shared<PackExtent<U>>(data)),
-		_begin(_extent->address()),
-		BaseSlice(data.size()) {
+		BaseSlice(data.size()),
+		_extent(PackExtent<U>::construct(std::move(data))),
+		_begin(_extent->address()) {
 	}
 
 	inline PackSlice(const typename PackExtent<U>::Ref &extent, const U *begin, size_t size) :
@@ -276,9 +499,18 @@ public:
     inline constexpr TypeMask type_mask() const {
 	    // constexpr is important here, as it allows apply() to optimize this for most cases that
 	    // need specific type masks (e.g. optimize evaluate of leaves on PackSlices to a noop).
-        return MakeTypeMask(TypeFromPrimitive<U>::type);
+        return PackSliceTypeMask<U>::mask;
     }
 
+	// the packed values, e.g. for summing them up without going through leaves().
+	inline const U *data() const {
+		return _begin;
+	}
+
+	inline const typename PackExtent<U>::Ref &extent() const {
+		return _extent;
+	}
+
 	template<typename V>
 	PrimitiveCollection<V> primitives() const {
 		return PrimitiveCollection<V>(_begin, BaseSlice::_size, PromotePrimitive<V>());
@@ -292,6 +524,12 @@ public:
 		return from_primitive(_begin[i]);
 	}
 
+	// calls f with leaf i as a const BaseExpression &, without allocating it (see with_atom()).
+	template<typename F>
+	inline auto with_leaf(size_t i, const F &f) const {
+		return with_atom(_begin[i], f);
+	}
+
 	PackSlice<U> slice(index_t begin, index_t end = INDEX_MAX) const {
         const size_t size = BaseSlice::_size;
 
@@ -320,6 +558,14 @@ public:
 		return true;
 	}
 
+	// packed leaves are never rewritten in place.
+	inline BaseExpressionRef *mutable_refs() const {
+		return nullptr;
+	}
+
+	inline void set_type_mask(TypeMask type_mask) const {
+	}
+
 	RefsSlice unpack() const;
 
 	inline const BaseExpressionRef *refs() const {
@@ -327,28 +573,98 @@ public:
 	}
 };
 
+// like a PackExtent, a RefsExtent stores its leaves inline. an extent is either allocated on
+// its own, or it shares one block with the expression that created it (see Heap::Expression);
+// in the latter case, the block is freed as soon as both the expression and all slices that
+// still refer to the extent are gone.
+
 class RefsExtent {
 private:
-	const std::vector<BaseExpressionRef> _data;
+	size_t _ref_count;
+	const size_t _size;
+	void * const _block; // nullptr if allocated on its own
+
+	static constexpr size_t data_offset() {
+		return (sizeof(RefsExtent) + alignof(BaseExpressionRef) - 1) & ~(alignof(BaseExpressionRef) - 1);
+	}
+
+	inline BaseExpressionRef *data() {
+		return reinterpret_cast<BaseExpressionRef*>(reinterpret_cast<char*>(this) + data_offset());
+	}
+
+	inline RefsExtent(size_t size, void *block) : _ref_count(0), _size(size), _block(block) {
+	}
+
+	template<typename Iterator>
+	static inline RefsExtent *create(void *memory, void *block, size_t size, Iterator first) {
+		RefsExtent * const extent = new(memory) RefsExtent(size, block);
+		std::uninitialized_copy_n(first, size, extent->data()); // copying refs does not throw
+		return extent;
+	}
+
+	template<typename Iterator>
+	static inline RefsExtent *create(size_t size, Iterator first) {
+		Heap::extent_allocated(allocation_size(size));
+		void *memory;
+		try {
+			memory = ::operator new(allocation_size(size));
+		} catch(...) {
+			Heap::extent_freed(allocation_size(size));
+			throw;
+		}
+		return create(memory, nullptr, size, first);
+	}
+
+	static void destroy(RefsExtent *extent);
 
 public:
-	typedef std::shared_ptr<RefsExtent> Ref;
+	typedef boost::intrusive_ptr<RefsExtent> Ref;
+
+	static constexpr size_t allocation_size(size_t size) {
+		return data_offset() + size * sizeof(BaseExpressionRef);
+	}
+
+	static inline Ref construct(const std::vector<BaseExpressionRef> &data) {
+		return Ref(create(data.size(), data.begin()));
+	}
 
-	inline explicit RefsExtent(const std::vector<BaseExpressionRef> &data) : _data(data) {
+	static inline Ref construct(std::vector<BaseExpressionRef> &&data) {
+		return Ref(create(data.size(), std::make_move_iterator(data.begin())));
 	}
 
-	inline explicit RefsExtent(std::vector<BaseExpressionRef> &&data) : _data(data) {
+	static inline Ref construct(const std::initializer_list<BaseExpressionRef> &data) {
+		return Ref(create(data.size(), data.begin()));
 	}
 
-	inline explicit RefsExtent(const std::initializer_list<BaseExpressionRef> &data) : _data(data) {
+	// constructs an extent at memory, which lies inside the given (Heap allocated) block.
+	static inline Ref construct(void *memory, void *block, std::vector<BaseExpressionRef> &&data) {
+		return Ref(create(memory, block, data.size(), std::make_move_iterator(data.begin())));
 	}
 
-	inline const BaseExpressionRef *address() const {
-		return &_data[0];
+	inline const BaseExpressionRef *address() {
+		return data();
 	}
 
 	inline size_t size() const {
-		return _data.size();
+		return _size;
+	}
+
+	inline const void *block() const {
+		return _block;
+	}
+
+	inline bool is_unique() const {
+		return _ref_count == 1;
+	}
+
+	friend inline void intrusive_ptr_add_ref(RefsExtent *extent) {
+		++extent->_ref_count;
+	}
+
+	friend inline void intrusive_ptr_release(RefsExtent *extent) {
+		if (--extent->_ref_count == 0) {
+			destroy(extent);
+		}
 	}
 };
 
@@ -389,6 +705,10 @@ public:
 		}
 	}
 
+    inline void set_type_mask(TypeMask type_mask) const {
+        _type_mask = type_mask;
+    }
+
     inline TypeMask type_mask() const {
         if (_type_mask) {
 	        return *_type_mask;
@@ -420,18 +740,23 @@ public:
     inline const BaseExpressionRef &operator[](size_t i) const {
         return _begin[i];
     }
+
+    template<typename F>
+    inline auto with_leaf(size_t i, const F &f) const {
+        return f(static_cast<const BaseExpression&>(*_begin[i]));
+    }
 };
 
 class RefsSlice : public BaseRefsSlice<size_t, SliceTypeId::RefsSliceCode> {
 private:
 	typename RefsExtent::Ref _extent;
 
+public:
     inline RefsSlice(const typename RefsExtent::Ref &extent, OptionalTypeMask type_mask) :
         BaseRefsSlice(extent->address(), extent->size(), type_mask),
         _extent(extent) {
     }
 
-public:
     inline RefsSlice(const RefsSlice &slice) :
         BaseRefsSlice(slice._begin, slice._size, slice._type_mask),
         _extent(slice._extent) {
@@ -441,15 +766,15 @@ public:
 	}
 
     inline RefsSlice(const std::vector<BaseExpressionRef> &data, OptionalTypeMask type_mask) :
-        RefsSlice(std::make_shared<RefsExtent>(data), type_mask) {
+        RefsSlice(RefsExtent::construct(data), type_mask) {
 	}
 
 	inline RefsSlice(std::vector<BaseExpressionRef> &&data, OptionalTypeMask type_mask) :
-        RefsSlice(std::make_shared<RefsExtent>(data), type_mask) {
+        RefsSlice(RefsExtent::construct(std::move(data)), type_mask) {
 	}
 
 	inline RefsSlice(const std::initializer_list<BaseExpressionRef> &data, OptionalTypeMask type_mask) :
-        RefsSlice(std::make_shared<RefsExtent>(data), type_mask) {
+        RefsSlice(RefsExtent::construct(data), type_mask) {
 	}
 
 	inline RefsSlice(
@@ -498,6 +823,19 @@ public:
 	inline const BaseExpressionRef *refs() const {
 		return _begin;
 	}
+
+	// our leaves, if no other slice shares them.
+	inline BaseExpressionRef *mutable_refs() const {
+		if (_extent && _extent->is_unique()) {
+			return const_cast<BaseExpressionRef*>(_begin);
+		} else {
+			return nullptr;
+		}
+	}
+
+	inline const typename RefsExtent::Ref &extent() const {
+		return _extent;
+	}
 };
 
 template<size_t N>
@@ -573,6 +911,10 @@ public:
 	inline const BaseExpressionRef *refs() const {
 		return &_refs[0];
 	}
+
+	inline BaseExpressionRef *mutable_refs() const {
+		return &_refs[0];
+	}
 };
 
 typedef InPlaceRefsSlice<0> EmptySlice;
@@ -580,11 +922,119 @@ typedef InPlaceRefsSlice<0> EmptySlice;
 template<typename U>
 inline RefsSlice PackSlice<U>::unpack() const {
 	std::vector<BaseExpressionRef> leaves;
+	leaves.reserve(BaseSlice::_size);
 	for (auto leaf : this->leaves()) {
 		leaves.push_back(leaf);
 	}
 	return RefsSlice(std::move(leaves), type_mask());
 }
 
+// packed strings keep all their bytes in one StringExtent. leaves are String atoms that
+// point into the extent, so handing them out does not copy any bytes.
+
+template<>
+class PackSlice<std::string> : public Slice<size_t, PackSliceStringCode> {
+private:
+	StringExtent::Ref _extent;
+	const size_t _begin;
+
+public:
+	template<typename V>
+	using PrimitiveCollection = IndexedCollection<PackSlice<std::string>, BaseExpressionToPrimitive<V>>;
+
+	using LeafCollection = IndexedCollection<PackSlice<std::string>, PassBaseExpression>;
+
+	using BaseSlice = Slice<size_t, PackSliceStringCode>;
+
+public:
+	inline PackSlice(const std::vector<std::string> &data) :
+		BaseSlice(data.size()),
+		_extent(StringExtent::construct(data)),
+		_begin(0) {
+	}
+
+	inline PackSlice(const StringExtent::Ref &extent, size_t begin, size_t size) :
+		BaseSlice(size),
+		_extent(extent),
+		_begin(begin) {
+	}
+
+	inline constexpr TypeMask type_mask() const {
+		return PackSliceTypeMask<std::string>::mask;
+	}
+
+	inline const StringExtent::Ref &extent() const {
+		return _extent;
+	}
+
+	inline std::experimental::string_view view(size_t i) const {
+		return (*_extent)[_begin + i];
+	}
+
+	// the number of bytes our strings take in the extent.
+	inline size_t byte_count() const {
+		return _extent->byte_count(_begin, _begin + _size);
+	}
+
+	template<typename V>
+	PrimitiveCollection<V> primitives() const {
+		return PrimitiveCollection<V>(this, BaseExpressionToPrimitive<V>());
+	}
+
+	LeafCollection leaves() const {
+		return LeafCollection(this, PassBaseExpression());
+	}
+
+	inline BaseExpressionRef operator[](size_t i) const {
+		return Heap::String(_extent, view(i));
+	}
+
+	template<typename F>
+	inline auto with_leaf(size_t i, const F &f) const {
+		const String atom(_extent, view(i));
+		return f(static_cast<const BaseExpression&>(atom));
+	}
+
+	PackSlice<std::string> slice(index_t begin, index_t end = INDEX_MAX) const {
+		const size_t size = _size;
+
+		if (begin < 0) {
+			begin = size - (-begin % size);
+		}
+		if (end < 0) {
+			end = size - (-end % size);
+		}
+
+		end = std::min(end, index_t(size));
+		begin = std::min(begin, end);
+
+		return PackSlice<std::string>(_extent, _begin + begin, end - begin);
+	}
+
+	inline bool is_packed() const {
+		return true;
+	}
+
+	inline BaseExpressionRef *mutable_refs() const {
+		return nullptr;
+	}
+
+	inline void set_type_mask(TypeMask type_mask) const {
+	}
+
+	inline RefsSlice unpack() const {
+		std::vector<BaseExpressionRef> leaves;
+		leaves.reserve(_size);
+		for (auto leaf : this->leaves()) {
+			leaves.push_back(leaf);
+		}
+		return RefsSlice(std::move(leaves), type_mask());
+	}
+
+	inline const BaseExpressionRef *refs() const {
+		throw std::runtime_error("cannot get refs on PackSlice");
+	}
+};
+
 
 #endif //CMATHICS_LEAVES_H
@@ -0,0 +1,83 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include "mapped.h"
+#include "expression.h"
+#include "definitions.h"
+#include "evaluation.h"
+
+const void *map_file(const char *path, size_t &bytes) {
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error(std::string("cannot open ") + path + ": " + strerror(errno));
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		const int error = errno;
+		close(fd);
+		throw std::runtime_error(std::string("cannot stat ") + path + ": " + strerror(error));
+	}
+
+	bytes = static_cast<size_t>(info.st_size);
+	if (bytes == 0) {
+		close(fd);
+		return nullptr; // mmap() refuses empty mappings
+	}
+
+	void * const data = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+	const int error = errno;
+	close(fd); // the mapping keeps the file open
+
+	if (data == MAP_FAILED) {
+		throw std::runtime_error(std::string("cannot map ") + path + ": " + strerror(error));
+	}
+
+	return data;
+}
+
+void unmap_file(const void *data, size_t bytes) {
+	if (data) {
+		munmap(const_cast<void*>(data), bytes);
+	}
+}
+
+namespace {
+	template<typename U>
+	inline BaseExpressionRef read_list(const char *path, const Evaluation &evaluation) {
+		const typename PackExtent<U>::Ref extent = PackExtent<U>::map(path);
+		return expression(evaluation.definitions.List(), PackSlice<U>(extent, extent->address(), extent->size()));
+	}
+}
+
+BaseExpressionRef BinaryReadList(
+	const BaseExpressionRef &file,
+	const BaseExpressionRef &type,
+	const Evaluation &evaluation) {
+
+	const char * const path = file->get_string_value();
+	const char * const name = type->get_string_value();
+	if (!path || !name) {
+		return BaseExpressionRef();
+	}
+
+	// errors must not escape evaluation.
+	try {
+		if (strcmp(name, "Integer64") == 0) {
+			return read_list<machine_integer_t>(path, evaluation);
+		} else if (strcmp(name, "Real64") == 0) {
+			return read_list<machine_real_t>(path, evaluation);
+		} else if (strcmp(name, "Complex128") == 0) {
+			return read_list<machine_complex_t>(path, evaluation);
+		} else {
+			return BaseExpressionRef();
+		}
+	} catch (const std::runtime_error&) {
+		return evaluation.definitions.lookup("System`$Failed");
+	}
+}
@@ -0,0 +1,25 @@
+#ifndef CMATHICS_MAPPED_H
+#define CMATHICS_MAPPED_H
+
+#include <stddef.h>
+
+#include "types.h"
+
+// maps the file at path read-only into memory, and returns the start of the mapping and
+// its size in bytes (nullptr and 0 for empty files). throws std::runtime_error if the file
+// cannot be mapped. the mapping is private, so later changes to the file are not guaranteed
+// to become visible through it, and it never gets written to.
+const void *map_file(const char *path, size_t &bytes);
+
+void unmap_file(const void *data, size_t bytes);
+
+// BinaryReadList[file, type] for type "Integer64", "Real64" or "Complex128": a packed List
+// of the values in file (in native byte order), which refers to a mapping of the file
+// instead of a copy. returns $Failed if the file cannot be mapped or its size is not a
+// multiple of the type's size, and an empty ref for other arguments.
+BaseExpressionRef BinaryReadList(
+	const BaseExpressionRef &file,
+	const BaseExpressionRef &type,
+	const Evaluation &evaluation);
+
+#endif //CMATHICS_MAPPED_H
@@ -69,13 +69,17 @@ private:
 	const bool _matched;
 	const MatchId _id;
 	const Symbol *_variables;
+	SymbolFilter _symbols;
 
 public:
-	explicit inline Match() : _matched(false) {
+	explicit inline Match() : _matched(false), _symbols(0) {
 	}
 
 	explicit inline Match(bool matched, const MatchContext &context) :
-		_matched(matched), _id(context.id), _variables(context.matched_variables.get()) {
+		_matched(matched), _id(context.id), _variables(context.matched_variables.get()), _symbols(0) {
+		for (const Symbol *symbol = _variables; symbol; symbol = symbol->next_variable()) {
+			_symbols |= symbol_filter(symbol);
+		}
 	}
 
 	inline operator bool() const {
@@ -90,6 +94,11 @@ public:
 		return _variables;
 	}
 
+	// a filter of all variables in variables().
+	inline SymbolFilter symbols() const {
+		return _symbols;
+	}
+
 	template<int N>
 	typename BaseExpressionTuple<N>::type get() const;
 };
@@ -199,7 +208,9 @@ public:
 				// expr is always pattern[0].
 				if ( _sequence.size() == 0) {
 					return false;
-				} else if (_this_pattern->same(_sequence[0])) {
+				} else if (_sequence.with_leaf(0, [this] (const BaseExpression &leaf) {
+						return _this_pattern->same(leaf);
+					})) {
 					return shift(1, nullptr);
 				} else {
 					return false;
@@ -232,6 +243,10 @@ public:
 			default:
 				if (_sequence.size() == 0) {
 					return false;
+				} else if (!_sequence.with_leaf(0, [] (const BaseExpression &leaf) {
+						return leaf.type() == ExpressionType;
+					})) {
+					return false; // e.g. a packed leaf, which we do not allocate for this
 				} else {
 					auto next = _sequence[0];
 					if (next->type() == ExpressionType) {
@@ -285,8 +300,11 @@ public:
 inline Match match(const BaseExpressionRef &patt, const BaseExpressionRef &item, Definitions &definitions) {
 	MatchContext context(patt, item, definitions);
 	{
-		Matcher<InPlaceRefsSlice<1>> matcher(
-			context, patt, RefsSlice(), InPlaceRefsSlice<1>(&item, 1, item->type_mask()));
+		// Matcher only keeps references to its slices, so they must outlive it.
+		const RefsSlice no_next_pattern;
+		const InPlaceRefsSlice<1> sequence(&item, 1, item->type_mask());
+
+		Matcher<InPlaceRefsSlice<1>> matcher(context, patt, no_next_pattern, sequence);
 
 		if (matcher.match_sequence()) {
 			return Match(true, context);
@@ -303,7 +321,10 @@ bool Matcher<Slice>::heads(size_t n, const Symbol *head) const {
 			static_cast<BaseExpressionPtr>(head);
 
 	for (size_t i = 0; i < n; i++) {
-		if (head_expr != _sequence[i]->head_ptr()) {
+		const bool same_head = _sequence.with_leaf(i, [head_expr] (const BaseExpression &leaf) {
+			return leaf.head_ptr() == head_expr;
+		});
+		if (!same_head) {
 			return i;
 		}
 	}
@@ -325,7 +346,9 @@ bool Matcher<Slice>::consume(size_t n) const {
 		auto next = _next_pattern[0];
 		auto rest = _next_pattern.slice(1);
 
-		Matcher<Slice> matcher(_context, next, rest, _sequence.slice(n));
+		const auto sequence = _sequence.slice(n);
+
+		Matcher<Slice> matcher(_context, next, rest, sequence);
 		return matcher.match_sequence();
 	}
 }
@@ -412,6 +435,14 @@ bool Matcher<Slice>::shift(size_t match_size, const Symbol *head, bool make_sequ
 	}
 
 	if (match_size == 1 && !make_sequence) {
+		const BaseExpressionRef existing = _variable->matched_value(_context.id);
+		if (existing) {
+			// only a new binding needs a ref, checking an existing one can borrow the leaf.
+			const bool same = _sequence.with_leaf(0, [&existing] (const BaseExpression &leaf) {
+				return existing->same(leaf);
+			});
+			return same && consume(match_size);
+		}
 		return match_variable(match_size, _sequence[0]);
 	} else {
 		return match_variable(match_size, expression(
@@ -431,7 +462,9 @@ bool ExpressionImplementation<Slice>::match_leaves(MatchContext &context, const
 	auto patt_expr = patt->to_refs_expression(patt);
 	auto patt_sequence = patt_expr->_leaves;
 
-	Matcher <Slice> matcher(context, patt_sequence[0], patt_sequence.slice(1), _leaves);
+	const auto patt_rest = patt_sequence.slice(1);
+
+	Matcher<Slice> matcher(context, patt_sequence[0], patt_rest, _leaves);
 	return matcher.match_sequence();
 }
 
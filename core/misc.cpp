@@ -3,27 +3,18 @@
 #include "misc.h"
 
 int64_t Expression_height(BaseExpressionPtr expression) {
-    /*int64_t result;
-    uint32_t leaf_height;
-    int64_t i;
-    Expression* nexpression;
-
     assert(expression != NULL);
-    switch (expression->type()) {
-        case ExpressionType:
-            nexpression = (Expression*) expression;
-            result = Expression_height(nexpression->_head.get());
-            for (auto leaf : nexpression->_leaves) {
-                leaf_height = Expression_height(leaf.get());
-                if (leaf_height > result) {
-                    result = leaf_height;
-                }
-            }
-            result++; // for this level
-            break;
-        default:
-            result = 1;
-    }
-    return result;*/
-    return 0;
+    return metadata_of(*expression).depth;
+}
+
+BaseExpressionRef Depth(
+	const BaseExpressionRef &expr,
+	const Evaluation &evaluation) {
+	return from_primitive(machine_integer_t(metadata_of(*expr).depth));
+}
+
+BaseExpressionRef LeafCount(
+	const BaseExpressionRef &expr,
+	const Evaluation &evaluation) {
+	return from_primitive(machine_integer_t(metadata_of(*expr).leaf_count));
 }
@@ -7,4 +7,12 @@
 
 int64_t Expression_height(BaseExpression* expression);
 
+BaseExpressionRef Depth(
+	const BaseExpressionRef &expr,
+	const Evaluation &evaluation);
+
+BaseExpressionRef LeafCount(
+	const BaseExpressionRef &expr,
+	const Evaluation &evaluation);
+
 #endif
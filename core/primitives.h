@@ -4,6 +4,7 @@
 #include "integer.h"
 #include "real.h"
 #include "rational.h"
+#include "complex.h"
 
 class to_primitive_error : public std::runtime_error {
 public:
@@ -39,9 +40,25 @@ inline int64_t to_primitive<int64_t>(const BaseExpressionRef &expr) {
 	}
 }
 
+template<>
+inline mpz_class to_primitive<mpz_class>(const BaseExpressionRef &expr) {
+	switch (expr->type()) {
+		case MachineIntegerType:
+			return mpz_class(static_cast<long>(boost::static_pointer_cast<const MachineInteger>(expr)->value));
+		case BigIntegerType:
+			return boost::static_pointer_cast<const BigInteger>(expr)->value;
+		default:
+			throw to_primitive_error(expr->type(), "mpz_class");
+	}
+}
+
 template<>
 inline mpq_class to_primitive<mpq_class>(const BaseExpressionRef &expr) {
 	switch (expr->type()) {
+		case MachineIntegerType:
+			return mpq_class(static_cast<long>(boost::static_pointer_cast<const MachineInteger>(expr)->value));
+		case BigIntegerType:
+			return mpq_class(boost::static_pointer_cast<const BigInteger>(expr)->value);
 		case RationalType:
 			return boost::static_pointer_cast<const Rational>(expr)->value;
 		default:
@@ -109,6 +126,12 @@ public:
 	static constexpr Type type = MachineRealType;
 };
 
+template<>
+class TypeFromPrimitive<machine_complex_t> {
+public:
+	static constexpr Type type = MachineComplexType;
+};
+
 template<>
 class TypeFromPrimitive<std::string> {
 public:
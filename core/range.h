@@ -0,0 +1,170 @@
+#ifndef CMATHICS_RANGE_H
+#define CMATHICS_RANGE_H
+
+#include "leaves.h"
+
+// a RangeSlice is the arithmetic progression start, start + step, ..., which only stores
+// its first element, its step and its size. leaves are computed on access, so that e.g.
+// Length[Range[n]] or Total[Range[n]] (see add_integers()) take O(1) time and memory.
+
+template<typename TypeConverter>
+class RangeIterator {
+private:
+	const TypeConverter _converter;
+	machine_integer_t _value;
+	const machine_integer_t _step;
+	size_t _index;
+
+public:
+	inline RangeIterator(const TypeConverter &converter, machine_integer_t value, machine_integer_t step, size_t index) :
+		_converter(converter), _value(value), _step(step), _index(index) {
+	}
+
+	inline auto operator*() const {
+		return _converter.convert(_value);
+	}
+
+	inline bool operator==(const RangeIterator<TypeConverter> &other) const {
+		return _index == other._index;
+	}
+
+	inline bool operator!=(const RangeIterator<TypeConverter> &other) const {
+		return _index != other._index;
+	}
+
+	inline RangeIterator<TypeConverter> &operator++() {
+		// computed without overflow, as we step past the last element.
+		_value = machine_integer_t(uint64_t(_value) + uint64_t(_step));
+		_index++;
+		return *this;
+	}
+};
+
+template<typename TypeConverter>
+class RangeCollection {
+private:
+	const TypeConverter _converter;
+	const machine_integer_t _start;
+	const machine_integer_t _step;
+	const size_t _size;
+
+public:
+	using Iterator = RangeIterator<TypeConverter>;
+
+	inline RangeCollection(machine_integer_t start, machine_integer_t step, size_t size, const TypeConverter &converter) :
+		_converter(converter), _start(start), _step(step), _size(size) {
+	}
+
+	inline Iterator begin() const {
+		return Iterator(_converter, _start, _step, 0);
+	}
+
+	inline Iterator end() const {
+		return Iterator(_converter, _start, _step, _size);
+	}
+};
+
+class RangeSlice : public Slice<size_t, RangeSliceCode> {
+private:
+	const machine_integer_t _start;
+	const machine_integer_t _step;
+
+public:
+	template<typename V>
+	using PrimitiveCollection = RangeCollection<PromotePrimitive<V>>;
+
+	using LeafCollection = RangeCollection<PrimitiveToBaseExpression<machine_integer_t>>;
+
+	// all elements must fit into a machine_integer_t.
+	inline RangeSlice(machine_integer_t start, machine_integer_t step, size_t size) :
+		Slice<size_t, RangeSliceCode>(size), _start(start), _step(step) {
+		assert(step != 0 || size <= 1);
+	}
+
+	inline machine_integer_t start() const {
+		return _start;
+	}
+
+	inline machine_integer_t step() const {
+		return _step;
+	}
+
+	inline constexpr TypeMask type_mask() const {
+		return MakeTypeMask(MachineIntegerType);
+	}
+
+	template<typename V>
+	inline PrimitiveCollection<V> primitives() const {
+		return PrimitiveCollection<V>(_start, _step, _size, PromotePrimitive<V>());
+	}
+
+	inline LeafCollection leaves() const {
+		return LeafCollection(_start, _step, _size, PrimitiveToBaseExpression<machine_integer_t>());
+	}
+
+	inline machine_integer_t value(size_t i) const {
+		// unsigned, as i * _step alone may overflow even if the value does not.
+		return machine_integer_t(uint64_t(_start) + uint64_t(i) * uint64_t(_step));
+	}
+
+	inline BaseExpressionRef operator[](size_t i) const {
+		return from_primitive(value(i));
+	}
+
+	template<typename F>
+	inline auto with_leaf(size_t i, const F &f) const {
+		return with_atom(value(i), f);
+	}
+
+	RangeSlice slice(index_t begin, index_t end = INDEX_MAX) const {
+		const size_t size = _size;
+
+		if (begin < 0) {
+			begin = size - (-begin % size);
+		}
+		if (end < 0) {
+			end = size - (-end % size);
+		}
+
+		end = std::min(end, index_t(size));
+		begin = std::min(begin, end);
+
+		return RangeSlice(begin < end ? value(begin) : _start, _step, end - begin);
+	}
+
+	// the elements as an ordinary packed slice, for code that needs them in memory.
+	inline PackSlice<machine_integer_t> materialize() const {
+		std::vector<machine_integer_t> values;
+		values.reserve(_size);
+		for (size_t i = 0; i < _size; i++) {
+			values.push_back(value(i));
+		}
+		return PackSlice<machine_integer_t>(std::move(values));
+	}
+
+	inline bool is_packed() const {
+		return true;
+	}
+
+	inline BaseExpressionRef *mutable_refs() const {
+		return nullptr;
+	}
+
+	inline void set_type_mask(TypeMask type_mask) const {
+	}
+
+	inline RefsSlice unpack() const {
+		std::vector<BaseExpressionRef> leaves;
+		leaves.reserve(_size);
+		for (auto leaf : this->leaves()) {
+			leaves.push_back(leaf);
+		}
+		return RefsSlice(std::move(leaves), type_mask());
+	}
+
+	inline const BaseExpressionRef *refs() const {
+		throw std::runtime_error("cannot get refs on RangeSlice");
+	}
+};
+
+#endif //CMATHICS_RANGE_H
@@ -14,20 +14,16 @@ public:
     }
 
     virtual hash_t hash() const {
-        /*uint64_t seed = 0;
-
-        numer = (BaseExpression*) Rational_numer(expression);
-        denom = (BaseExpression*) Rational_denom(expression);
-
-        seed = hash_combine(seed, rational_hash);
-        seed = hash_combine(seed, Hash(numer));
-        seed = hash_combine(seed, Hash(denom));*/
-
-        return 0;
+        // mpq_class values are canonical, so equal values have equal numerators and denominators.
+        return hash_mpz(hash_mpz(rational_hash, value.get_num()), value.get_den());
     }
 
     virtual bool same(const BaseExpression &expr) const {
-        return false; // FIXME
+        if (expr.type() == RationalType) {
+            return value == static_cast<const Rational*>(&expr)->value;
+        } else {
+            return false;
+        }
     }
 
     virtual std::string fullform() const {
@@ -52,7 +52,7 @@ std::pair<int32_t,double> precision_of(const BaseExpressionRef &expr) {
                 return std::pair<int32_t, double>(2, result);
             }
         }
-        case ComplexType:
+        case MachineComplexType:
             // TODO
         default:
             return std::pair<int32_t,double>(0,  0.0);
@@ -24,8 +24,7 @@ public:
     }
 
     virtual hash_t hash() const {
-        // TODO better hash see CPython _Py_HashDouble
-        return hash_pair(machine_real_hash, (uint64_t)value);
+        return hash_machine_real(value);
     }
 
     virtual std::string fullform() const {
@@ -69,8 +68,8 @@ public:
     }
 
     virtual hash_t hash() const {
-        // TODO hash
-        return 0;
+        // values that are the same() round to the same double.
+        return hash_mix(big_real_hash ^ real_bits(_value.toDouble()));
     }
 
     virtual std::string fullform() const {
@@ -81,15 +80,15 @@ public:
 };
 
 inline BaseExpressionRef from_primitive(machine_real_t value) {
-	return BaseExpressionRef(new MachineReal(value));
+	return Heap::MachineReal(value);
 }
 
 inline BaseExpressionRef from_primitive(const mpfr::mpreal &value) {
-	return BaseExpressionRef(new BigReal(value));
+	return Heap::BigReal(value);
 }
 
 inline BaseExpressionRef real(double prec, machine_real_t value) {
-	return BaseExpressionRef(new BigReal(prec, value));
+	return Heap::BigReal(prec, value);
 }
 
 std::pair<int32_t,double> precision_of(const BaseExpressionRef&);
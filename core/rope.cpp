@@ -0,0 +1,205 @@
+#include "rope.h"
+#include "expression.h"
+
+namespace {
+	// chunks of at most this many leaves get merged when ropes are joined, so that building
+	// a rope one leaf at a time does not end up with one node per leaf.
+	constexpr size_t RopeChunkSize = 32;
+
+	ExpressionRef merge_chunks(const RopeNode *a, const RopeNode *b) {
+		std::vector<BaseExpressionRef> leaves;
+		leaves.reserve(a->size() + b->size());
+		for (const RopeNode *node : {a, b}) {
+			const Expression * const chunk = node->chunk_expr();
+			const size_t end = node->chunk_begin() + node->size();
+			for (size_t i = node->chunk_begin(); i < end; i++) {
+				leaves.push_back(chunk->leaf(i));
+			}
+		}
+		return expression(a->chunk_expr()->_head, std::move(leaves));
+	}
+
+	inline const RopeNode *rightmost(const RopeNode *node) {
+		size_t i = node->size() - 1;
+		return node->find(i);
+	}
+
+	inline const RopeNode *leftmost(const RopeNode *node) {
+		size_t i = 0;
+		return node->find(i);
+	}
+}
+
+RopeNode::Ref RopeNode::balance(const Ref &left, const Ref &right) {
+	// heights of left and right differ by at most 2, which one rotation fixes.
+	if (left->_height > right->_height + 1) {
+		if (left->_left->_height >= left->_right->_height) {
+			return create(left->_left, create(left->_right, right));
+		} else {
+			const Ref &middle = left->_right;
+			return create(create(left->_left, middle->_left), create(middle->_right, right));
+		}
+	} else if (right->_height > left->_height + 1) {
+		if (right->_right->_height >= right->_left->_height) {
+			return create(create(left, right->_left), right->_right);
+		} else {
+			const Ref &middle = right->_left;
+			return create(create(left, middle->_left), create(middle->_right, right->_right));
+		}
+	} else {
+		return create(left, right);
+	}
+}
+
+RopeNode::Ref RopeNode::merge_right(const Ref &left, const Ref &right) {
+	// replaces the rightmost chunk of left with one that also holds the leaves of the chunk
+	// right. the height of left does not change.
+	if (left->is_chunk()) {
+		return chunk(merge_chunks(left.get(), right.get()), 0, left->_size + right->_size);
+	} else {
+		return create(left->_left, merge_right(left->_right, right));
+	}
+}
+
+RopeNode::Ref RopeNode::merge_left(const Ref &left, const Ref &right) {
+	if (right->is_chunk()) {
+		return chunk(merge_chunks(left.get(), right.get()), 0, left->_size + right->_size);
+	} else {
+		return create(merge_left(left, right->_left), right->_right);
+	}
+}
+
+RopeNode::Ref RopeNode::join(const Ref &left, const Ref &right) {
+	if (!left) {
+		return right;
+	} else if (!right) {
+		return left;
+	}
+
+	if (right->is_chunk() && right->_size + rightmost(left.get())->_size <= RopeChunkSize) {
+		return merge_right(left, right);
+	} else if (left->is_chunk() && left->_size + leftmost(right.get())->_size <= RopeChunkSize) {
+		return merge_left(left, right);
+	}
+
+	// walk down the spine of the higher tree until heights match, then rebalance on the
+	// way up. this takes O(|height(left) - height(right)|) steps.
+	if (left->_height > right->_height + 1) {
+		return balance(left->_left, join(left->_right, right));
+	} else if (right->_height > left->_height + 1) {
+		return balance(join(left, right->_left), right->_right);
+	} else {
+		return create(left, right);
+	}
+}
+
+RopeNode::Ref RopeNode::from(const ExpressionRef &expr) {
+	if (expr->slice_type_id() == RopeSliceCode) {
+		const RopeSlice &slice = static_cast<const ExpressionImplementation<RopeSlice>*>(expr.get())->_leaves;
+		if (slice.size() == 0) {
+			return Ref();
+		}
+		return slice.root()->slice(slice.offset(), slice.offset() + slice.size());
+	} else {
+		return chunk(expr, 0, expr->size());
+	}
+}
+
+RopeNode::Ref RopeNode::slice(size_t begin, size_t end) const {
+	assert(begin <= end && end <= _size);
+
+	if (begin == end) {
+		return Ref();
+	} else if (begin == 0 && end == _size) {
+		return Ref(const_cast<RopeNode*>(this));
+	} else if (is_chunk()) {
+		return chunk(_chunk, _begin + begin, end - begin);
+	}
+
+	const size_t n = _left->_size;
+	if (end <= n) {
+		return _left->slice(begin, end);
+	} else if (begin >= n) {
+		return _right->slice(begin - n, end - n);
+	} else {
+		return join(_left->slice(begin, n), _right->slice(0, end - n));
+	}
+}
+
+TypeMask RopeNode::type_mask() const {
+	if (!_type_mask) {
+		if (!is_chunk()) {
+			_type_mask = _left->type_mask() | _right->type_mask();
+		} else if (_begin == 0 && _size == _chunk->size()) {
+			_type_mask = _chunk->type_mask();
+		} else {
+			TypeMask mask = 0;
+			for (size_t i = 0; i < _size; i++) {
+				mask |= _chunk->leaf(_begin + i)->type_mask();
+			}
+			_type_mask = mask;
+		}
+	}
+	return *_type_mask;
+}
+
+TypeMask RopeNode::type_mask(size_t begin, size_t end) const {
+	if (begin >= end) {
+		return 0;
+	} else if (begin == 0 && end == _size) {
+		return type_mask();
+	} else if (is_chunk()) {
+		TypeMask mask = 0;
+		for (size_t i = begin; i < end; i++) {
+			mask |= _chunk->leaf(_begin + i)->type_mask();
+		}
+		return mask;
+	}
+
+	const size_t n = _left->_size;
+	TypeMask mask = 0;
+	if (begin < n) {
+		mask |= _left->type_mask(begin, std::min(end, n));
+	}
+	if (end > n) {
+		mask |= _right->type_mask(std::max(begin, n) - n, end - n);
+	}
+	return mask;
+}
+
+size_t RopeNode::count() const {
+	if (is_chunk()) {
+		return 1;
+	} else {
+		return 1 + _left->count() + _right->count();
+	}
+}
+
+void RopeSlice::flatten() const {
+	std::vector<BaseExpressionRef> leaves;
+	leaves.reserve(_size);
+	for (auto leaf : this->leaves()) {
+		leaves.push_back(leaf);
+	}
+	_flat = RefsExtent::construct(std::move(leaves));
+	_flat_begin = _flat->address();
+}
+
+ExpressionRef concatenate(const Expression *a, const Expression *b) {
+	const BaseExpressionRef &head = a->_head;
+
+	if (a->size() + b->size() <= RopeChunkSize) {
+		std::vector<BaseExpressionRef> leaves;
+		leaves.reserve(a->size() + b->size());
+		for (const Expression *expr : {a, b}) {
+			const size_t size = expr->size();
+			for (size_t i = 0; i < size; i++) {
+				leaves.push_back(expr->leaf(i));
+			}
+		}
+		return expression(head, std::move(leaves));
+	}
+
+	return Heap::Expression(head, RopeSlice(RopeNode::join(
+		RopeNode::from(ExpressionRef(a)), RopeNode::from(ExpressionRef(b)))));
+}
@@ -0,0 +1,359 @@
+#ifndef CMATHICS_ROPE_H
+#define CMATHICS_ROPE_H
+
+#include "leaves.h"
+
+// a rope keeps its leaves in a height balanced (AVL) tree of chunks, where each chunk is a
+// range of leaves of some other expression. concatenating two ropes builds O(log n) new
+// nodes and shares everything else, appending a leaf copies at most one small chunk.
+// nodes are immutable, so all ropes that were built from a node can share it.
+
+class RopeNode {
+public:
+	typedef boost::intrusive_ptr<RopeNode> Ref;
+
+private:
+	size_t _ref_count;
+	const size_t _size;
+	const size_t _height; // 1 for chunks
+	mutable OptionalTypeMask _type_mask;
+
+	// inner nodes
+	const Ref _left;
+	const Ref _right;
+
+	// chunks
+	const ExpressionRef _chunk;
+	const size_t _begin;
+
+	inline RopeNode(const ExpressionRef &chunk, size_t begin, size_t size) :
+		_ref_count(0), _size(size), _height(1), _chunk(chunk), _begin(begin) {
+	}
+
+	inline RopeNode(const Ref &left, const Ref &right) :
+		_ref_count(0),
+		_size(left->_size + right->_size),
+		_height(1 + std::max(left->_height, right->_height)),
+		_left(left),
+		_right(right),
+		_begin(0) {
+	}
+
+	template<typename... Args>
+	static Ref create(Args&&... args) {
+		Heap::extent_allocated(sizeof(RopeNode));
+		try {
+			return Ref(new RopeNode(std::forward<Args>(args)...));
+		} catch(...) {
+			Heap::extent_freed(sizeof(RopeNode));
+			throw;
+		}
+	}
+
+	static Ref balance(const Ref &left, const Ref &right);
+
+	static Ref merge_right(const Ref &left, const Ref &right);
+
+	static Ref merge_left(const Ref &left, const Ref &right);
+
+public:
+	// a rope over the leaves [begin, begin + size) of chunk, or an empty ref if size is 0.
+	static inline Ref chunk(const ExpressionRef &chunk, size_t begin, size_t size) {
+		return size ? create(chunk, begin, size) : Ref();
+	}
+
+	// all leaves of expr, sharing expr's nodes if it is a rope itself.
+	static Ref from(const ExpressionRef &expr);
+
+	// the leaves of left followed by those of right. either may be an empty ref.
+	static Ref join(const Ref &left, const Ref &right);
+
+	Ref slice(size_t begin, size_t end) const;
+
+	inline size_t size() const {
+		return _size;
+	}
+
+	inline size_t height() const {
+		return _height;
+	}
+
+	inline bool is_chunk() const {
+		return _chunk.get() != nullptr;
+	}
+
+	// the chunk that holds leaf i, where i becomes the index of that leaf in the chunk.
+	inline const RopeNode *find(size_t &i) const {
+		const RopeNode *node = this;
+		while (!node->is_chunk()) {
+			const size_t n = node->_left->_size;
+			if (i < n) {
+				node = node->_left.get();
+			} else {
+				i -= n;
+				node = node->_right.get();
+			}
+		}
+		return node;
+	}
+
+	inline BaseExpressionRef operator[](size_t i) const {
+		const RopeNode * const node = find(i);
+		return node->_chunk->leaf(node->_begin + i);
+	}
+
+	inline const Expression *chunk_expr() const {
+		return _chunk.get();
+	}
+
+	inline size_t chunk_begin() const {
+		return _begin;
+	}
+
+	TypeMask type_mask() const;
+
+	TypeMask type_mask(size_t begin, size_t end) const;
+
+	// the number of nodes, counting shared nodes each time.
+	size_t count() const;
+
+	friend inline void intrusive_ptr_add_ref(RopeNode *node) {
+		++node->_ref_count;
+	}
+
+	friend inline void intrusive_ptr_release(RopeNode *node) {
+		if (--node->_ref_count == 0) {
+			delete node;
+			Heap::extent_freed(sizeof(RopeNode));
+		}
+	}
+};
+
+// walks the leaves of a rope chunk by chunk, so that sequential access does not need a
+// lookup from the root for each leaf.
+
+template<typename TypeConverter>
+class RopeIterator {
+private:
+	const TypeConverter _converter;
+	const RopeNode *_root;
+	size_t _index;
+	size_t _end;
+	const Expression *_chunk;
+	size_t _chunk_index;
+	size_t _chunk_end;
+
+	inline void seek() {
+		size_t i = _index;
+		const RopeNode * const node = _root->find(i);
+		_chunk = node->chunk_expr();
+		_chunk_index = node->chunk_begin() + i;
+		_chunk_end = node->chunk_begin() + node->size();
+	}
+
+public:
+	inline RopeIterator(const TypeConverter &converter, const RopeNode *root, size_t index, size_t end) :
+		_converter(converter), _root(root), _index(index), _end(end),
+		_chunk(nullptr), _chunk_index(0), _chunk_end(0) {
+		if (_index < _end) {
+			seek();
+		}
+	}
+
+	inline auto operator*() const {
+		return _converter.convert(_chunk->leaf(_chunk_index));
+	}
+
+	inline bool operator==(const RopeIterator<TypeConverter> &other) const {
+		return _index == other._index;
+	}
+
+	inline bool operator!=(const RopeIterator<TypeConverter> &other) const {
+		return _index != other._index;
+	}
+
+	inline RopeIterator<TypeConverter> &operator++() {
+		_index++;
+		if (++_chunk_index == _chunk_end && _index < _end) {
+			seek();
+		}
+		return *this;
+	}
+};
+
+template<typename TypeConverter>
+class RopeCollection {
+private:
+	const TypeConverter _converter;
+	const RopeNode * const _root;
+	const size_t _begin;
+	const size_t _end;
+
+public:
+	using Iterator = RopeIterator<TypeConverter>;
+
+	inline RopeCollection(const RopeNode *root, size_t begin, size_t end, const TypeConverter &converter) :
+		_converter(converter), _root(root), _begin(begin), _end(end) {
+	}
+
+	inline Iterator begin() const {
+		return Iterator(_converter, _root, _begin, _end);
+	}
+
+	inline Iterator end() const {
+		return Iterator(_converter, _root, _end, _end);
+	}
+};
+
+// a RopeSlice is a window onto a rope. lookups by index go through the tree, until they
+// have cost about as much as copying all leaves once; from then on, the slice works on a
+// flat copy of its leaves (the same happens when someone asks for refs()).
+
+class RopeSlice : public Slice<size_t, RopeSliceCode> {
+private:
+	RopeNode::Ref _root;
+	size_t _offset;
+	mutable RefsExtent::Ref _flat;
+	mutable const BaseExpressionRef *_flat_begin;
+	mutable size_t _lookups;
+	mutable OptionalTypeMask _type_mask;
+
+	inline RopeSlice(
+		const RopeNode::Ref &root,
+		size_t offset,
+		size_t size,
+		const RefsExtent::Ref &flat,
+		const BaseExpressionRef *flat_begin,
+		OptionalTypeMask type_mask) :
+
+		Slice<size_t, RopeSliceCode>(size),
+		_root(root),
+		_offset(offset),
+		_flat(flat),
+		_flat_begin(flat_begin),
+		_lookups(0),
+		_type_mask(type_mask) {
+	}
+
+	void flatten() const;
+
+public:
+	template<typename V>
+	using PrimitiveCollection = RopeCollection<BaseExpressionToPrimitive<V>>;
+
+	using LeafCollection = RopeCollection<PassBaseExpression>;
+
+	inline explicit RopeSlice(const RopeNode::Ref &root) :
+		RopeSlice(root, 0, root ? root->size() : 0, RefsExtent::Ref(), nullptr, OptionalTypeMask()) {
+	}
+
+	inline const RopeNode::Ref &root() const {
+		return _root;
+	}
+
+	inline size_t offset() const {
+		return _offset;
+	}
+
+	// the flat copy of our leaves, if we made one.
+	inline const RefsExtent::Ref &flat() const {
+		return _flat;
+	}
+
+	inline TypeMask type_mask() const {
+		if (!_type_mask) {
+			_type_mask = _size ? _root->type_mask(_offset, _offset + _size) : 0;
+		}
+		return *_type_mask;
+	}
+
+	template<typename V>
+	inline PrimitiveCollection<V> primitives() const {
+		return PrimitiveCollection<V>(_root.get(), _offset, _offset + _size, BaseExpressionToPrimitive<V>());
+	}
+
+	inline LeafCollection leaves() const {
+		return LeafCollection(_root.get(), _offset, _offset + _size, PassBaseExpression());
+	}
+
+	inline BaseExpressionRef operator[](size_t i) const {
+		if (!_flat_begin) {
+			if (++_lookups * _root->height() < _size) {
+				return (*_root)[_offset + i];
+			}
+			flatten();
+		}
+		return _flat_begin[i];
+	}
+
+	// leaves of packed chunks still get allocated here, as chunks only offer leaf().
+	template<typename F>
+	inline auto with_leaf(size_t i, const F &f) const {
+		const BaseExpressionRef leaf = (*this)[i];
+		return f(static_cast<const BaseExpression&>(*leaf));
+	}
+
+	RopeSlice slice(index_t begin, index_t end = INDEX_MAX) const {
+		const size_t size = _size;
+
+		if (begin < 0) {
+			begin = size - (-begin % size);
+		}
+		if (end < 0) {
+			end = size - (-end % size);
+		}
+
+		end = std::min(end, (index_t)size);
+		begin = std::min(begin, end);
+
+		if (begin == 0 && end == (index_t)size) {
+			return *this;
+		}
+
+		OptionalTypeMask type_mask;
+		if (end <= begin) {
+			type_mask = 0;
+		} else if (_type_mask && is_homogenous(*_type_mask)) {
+			type_mask = _type_mask;
+		}
+
+		return RopeSlice(
+			_root,
+			_offset + begin,
+			end - begin,
+			_flat,
+			_flat_begin ? _flat_begin + begin : nullptr,
+			type_mask);
+	}
+
+	inline bool is_packed() const {
+		return false;
+	}
+
+	// rope nodes are shared, so leaves are never rewritten in place.
+	inline BaseExpressionRef *mutable_refs() const {
+		return nullptr;
+	}
+
+	inline void set_type_mask(TypeMask type_mask) const {
+		_type_mask = type_mask;
+	}
+
+	inline RefsSlice unpack() const {
+		const BaseExpressionRef * const leaves = refs();
+		return RefsSlice(_flat, leaves, leaves + _size, type_mask());
+	}
+
+	inline const BaseExpressionRef *refs() const {
+		if (!_flat_begin) {
+			flatten();
+		}
+		return _flat_begin;
+	}
+};
+
+// the leaves of a followed by those of b, under the head of a. short results are built as
+// ordinary expressions, longer ones as ropes.
+ExpressionRef concatenate(const Expression *a, const Expression *b);
+
+#endif //CMATHICS_ROPE_H
@@ -3,13 +3,148 @@
 
 #include "types.h"
 #include <string>
+#include <vector>
+#include <cstring>
+#include <experimental/string_view>
 #include "hash.h"
 
+// a StringExtent stores a sequence of strings in one single block: a header, an array of
+// offsets and all bytes, each string followed by a '\0'. packed string lists keep their
+// strings in such an extent, and String atoms may point into it instead of owning a copy.
+
+class StringExtent {
+private:
+    size_t _ref_count;
+    const size_t _size;
+    const size_t _bytes;
+
+    static constexpr size_t offsets_offset() {
+        return (sizeof(StringExtent) + alignof(size_t) - 1) & ~(alignof(size_t) - 1);
+    }
+
+    inline size_t *offsets() {
+        return reinterpret_cast<size_t*>(reinterpret_cast<char*>(this) + offsets_offset());
+    }
+
+    inline const size_t *offsets() const {
+        return reinterpret_cast<const size_t*>(reinterpret_cast<const char*>(this) + offsets_offset());
+    }
+
+    inline char *bytes() {
+        return reinterpret_cast<char*>(offsets() + _size + 1);
+    }
+
+    inline const char *bytes() const {
+        return reinterpret_cast<const char*>(offsets() + _size + 1);
+    }
+
+    inline StringExtent(size_t size, size_t bytes) : _ref_count(0), _size(size), _bytes(bytes) {
+    }
+
+    static void destroy(StringExtent *extent) {
+        const size_t size = allocation_size(extent->_size, extent->_bytes);
+        extent->~StringExtent();
+        ::operator delete(extent);
+        Heap::extent_freed(size);
+    }
+
+public:
+    typedef boost::intrusive_ptr<StringExtent> Ref;
+
+    static constexpr size_t allocation_size(size_t size, size_t bytes) {
+        return offsets_offset() + (size + 1) * sizeof(size_t) + bytes;
+    }
+
+    // an extent holding the n strings that first points to. we walk them twice, once to
+    // find the size of the block and once to fill it.
+    template<typename Iterator>
+    static Ref construct(size_t n, Iterator first) {
+        size_t bytes = 0;
+        Iterator it = first;
+        for (size_t i = 0; i < n; i++, ++it) {
+            bytes += std::experimental::string_view(*it).size() + 1;
+        }
+
+        const size_t size = allocation_size(n, bytes);
+        Heap::extent_allocated(size);
+        void *memory;
+        try {
+            memory = ::operator new(size);
+        } catch(...) {
+            Heap::extent_freed(size);
+            throw;
+        }
+
+        StringExtent * const extent = new(memory) StringExtent(n, bytes);
+        size_t * const offsets = extent->offsets();
+        char * const data = extent->bytes();
+
+        size_t offset = 0;
+        it = first;
+        for (size_t i = 0; i < n; i++, ++it) {
+            const std::experimental::string_view s(*it);
+            offsets[i] = offset;
+            std::memcpy(data + offset, s.data(), s.size());
+            offset += s.size();
+            data[offset++] = '\0';
+        }
+        offsets[n] = offset;
+
+        return Ref(extent);
+    }
+
+    static inline Ref construct(const std::vector<std::string> &strings) {
+        return construct(strings.size(), strings.begin());
+    }
+
+    inline std::experimental::string_view operator[](size_t i) const {
+        const size_t *offsets = this->offsets();
+        return std::experimental::string_view(bytes() + offsets[i], offsets[i + 1] - offsets[i] - 1);
+    }
+
+    inline size_t size() const {
+        return _size;
+    }
+
+    // the number of bytes that strings [begin, end) take in this extent.
+    inline size_t byte_count(size_t begin, size_t end) const {
+        const size_t *offsets = this->offsets();
+        return offsets[end] - offsets[begin] + (end - begin) * sizeof(size_t);
+    }
+
+    friend inline void intrusive_ptr_add_ref(StringExtent *extent) {
+        ++extent->_ref_count;
+    }
+
+    friend inline void intrusive_ptr_release(StringExtent *extent) {
+        if (--extent->_ref_count == 0) {
+            destroy(extent);
+        }
+    }
+};
+
 class String : public BaseExpression {
+private:
+    const std::string _owned; // empty if value lies in _extent
+    const StringExtent::Ref _extent;
+
 public:
-    const std::string value;
+    // always followed by a '\0'.
+    const std::experimental::string_view value;
+
+    explicit String(const std::string &new_value) :
+        BaseExpression(StringType), _owned(new_value), value(_owned) {
+    }
+
+    // a String that shares the bytes of value, which must lie in extent.
+    String(const StringExtent::Ref &extent, const std::experimental::string_view &value) :
+        BaseExpression(StringType), _extent(extent), value(value) {
+    }
+
+    String(const String&) = delete;
 
-    explicit String(const std::string &new_value) : BaseExpression(StringType), value(new_value) {
+    inline const StringExtent::Ref &extent() const {
+        return _extent;
     }
 
     virtual bool same(const BaseExpression &expr) const {
@@ -21,15 +156,15 @@ public:
     }
 
     virtual hash_t hash() const {
-        return hash_pair(string_hash, djb2(value.c_str()));
+        return hash_bytes(string_hash, value.data(), value.size());
     }
 
     virtual std::string fullform() const {
-        return value;
+        return value.to_string();
     }
 
     virtual const char *get_string_value() const {
-        return value.c_str();
+        return value.data();
     }
 
     virtual bool match(const BaseExpression &expr) const {
@@ -38,7 +173,7 @@ public:
 };
 
 inline BaseExpressionRef from_primitive(const std::string &value) {
-    return BaseExpressionRef(new String(value));
+    return Heap::String(value);
 }
 
 /*template<typename Alloc>
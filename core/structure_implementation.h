@@ -13,6 +13,13 @@ BaseExpressionRef StructureOperationsImplementation<T>::replace_slots(
 	const BaseExpressionRef &head = self._head;
 	const auto &leaves = self._leaves;
 
+	constexpr SymbolFilter slot_symbols =
+		(SymbolFilter(1) << (SymbolSlot >> CoreTypeBits)) |
+		(SymbolFilter(1) << (SymbolSlotSequence >> CoreTypeBits));
+	if ((self.metadata().symbols & slot_symbols) == 0) {
+		return BaseExpressionRef(); // no Slot anywhere below us
+	}
+
     switch (head->extended_type()) {
         case SymbolSlot:
             if (leaves.size() != 1) {
@@ -104,7 +104,7 @@ public:
 	}
 
 	virtual hash_t hash() const {
-		return hash_pair(symbol_hash, (std::uintptr_t)this);
+		return hash_mix(symbol_hash ^ (std::uintptr_t)this);
 	}
 
 	virtual std::string fullform() const {
@@ -196,7 +196,10 @@ inline BaseExpressionRef BaseExpression::evaluate(
 		const BaseExpressionRef &expr = result ? result : self;
 		switch (expr->type()) {
 			case ExpressionType:
-				form = static_cast<const Expression*>(expr.get())->evaluate_expression(expr, evaluation);
+				// intermediate forms are ours alone, unless some rule handed out a shared one.
+				// interned forms may be handed out again at any time, so they are never ours.
+				form = static_cast<const Expression*>(expr.get())->evaluate_expression(
+					expr, result && result->_ref_count == 1 && !result->is_interned(), evaluation);
 				break;
 			case SymbolType:
 				form = static_cast<const Symbol*>(expr.get())->evaluate_symbol();
@@ -0,0 +1,575 @@
+#include "tensor.h"
+#include "expression.h"
+#include "definitions.h"
+#include "evaluation.h"
+
+template<typename U>
+BaseExpressionRef tensor_expression(
+	const BaseExpressionRef &head,
+	const BaseExpressionRef &row_head,
+	const typename PackExtent<U>::Ref &extent,
+	const U *begin,
+	size_t rank,
+	const size_t *dims,
+	const index_t *strides) {
+
+	if (rank == 0) {
+		return from_primitive(*begin);
+	} else if (rank == 1 && strides[0] == 1) {
+		return expression(head, PackSlice<U>(extent, begin, dims[0]));
+	} else {
+		return expression(head, TensorSlice<U>(extent, begin, row_head, rank, dims, strides));
+	}
+}
+
+template<typename U>
+BaseExpressionRef TensorSlice<U>::row(size_t i) const {
+	return tensor_expression<U>(
+		_row_head, _row_head, _extent, _begin + i * _strides[0], _rank - 1, _dims + 1, _strides + 1);
+}
+
+template BaseExpressionRef TensorSlice<machine_integer_t>::row(size_t i) const;
+template BaseExpressionRef TensorSlice<machine_real_t>::row(size_t i) const;
+template BaseExpressionRef TensorSlice<machine_complex_t>::row(size_t i) const;
+
+namespace {
+	inline void contiguous_strides(size_t rank, const size_t *dims, index_t *strides) {
+		index_t stride = 1;
+		for (size_t k = rank; k-- > 0; ) {
+			strides[k] = stride;
+			stride *= dims[k];
+		}
+	}
+
+	template<typename U>
+	inline const TensorSlice<U> &tensor_slice(const Expression *expr) {
+		return static_cast<const ExpressionImplementation<TensorSlice<U>>*>(expr)->_leaves;
+	}
+
+	// whether the leaves of an expression with slice id can be viewed as a vector of U.
+	template<typename U>
+	inline bool is_packed_vector(SliceTypeId id) {
+		return id == PackSliceTypeId<U>::id;
+	}
+
+	template<>
+	inline bool is_packed_vector<machine_integer_t>(SliceTypeId id) {
+		return id == PackSliceMachineIntegerCode || id == RangeSliceCode;
+	}
+
+	template<typename U>
+	inline PackSlice<U> packed_vector(const Expression *expr) {
+		assert(expr->slice_type_id() == PackSliceTypeId<U>::id);
+		return static_cast<const ExpressionImplementation<PackSlice<U>>*>(expr)->_leaves;
+	}
+
+	template<>
+	inline PackSlice<machine_integer_t> packed_vector<machine_integer_t>(const Expression *expr) {
+		if (expr->slice_type_id() == RangeSliceCode) {
+			return static_cast<const ExpressionImplementation<RangeSlice>*>(expr)->_leaves.materialize();
+		}
+		assert(expr->slice_type_id() == PackSliceMachineIntegerCode);
+		return static_cast<const ExpressionImplementation<PackSlice<machine_integer_t>>*>(expr)->_leaves;
+	}
+
+	// the leaves of expr (which is packed over U) as a tensor. vectors become tensors of
+	// rank 1, using the head of expr as row head.
+	template<typename U>
+	TensorSlice<U> as_tensor(const Expression *expr) {
+		if (expr->slice_type_id() == TensorSliceTypeId<U>::id) {
+			return tensor_slice<U>(expr);
+		} else {
+			const PackSlice<U> slice = packed_vector<U>(expr);
+			const size_t dims[1] = {slice.size()};
+			const index_t strides[1] = {1};
+			return TensorSlice<U>(slice.extent(), slice.data(), expr->_head, 1, dims, strides);
+		}
+	}
+
+	// a copy of the elements of tensor in a new, contiguous extent.
+	template<typename U>
+	typename PackExtent<U>::Ref copy_elements(const TensorSlice<U> &tensor) {
+		std::vector<U> values;
+		values.reserve(tensor.element_count());
+		tensor.for_each_element([&values] (const U &value) {
+			values.push_back(value);
+		});
+		return PackExtent<U>::construct(std::move(values));
+	}
+
+	template<typename U>
+	ExpressionRef pack_rows(const BaseExpressionRef &head, const std::vector<BaseExpressionRef> &leaves) {
+		const Expression * const first = static_cast<const Expression*>(leaves[0].get());
+		const BaseExpressionRef &row_head = first->_head;
+		if (row_head->type() != SymbolType) {
+			return ExpressionRef();
+		}
+
+		// each row is viewed as a tensor only once, as ranges get materialized for this.
+		std::vector<TensorSlice<U>> rows;
+		rows.reserve(leaves.size());
+
+		for (const BaseExpressionRef &leaf : leaves) {
+			const Expression * const row = static_cast<const Expression*>(leaf.get());
+			const SliceTypeId id = row->slice_type_id();
+			if (!is_packed_vector<U>(id) && id != TensorSliceTypeId<U>::id) {
+				return ExpressionRef();
+			}
+			if (row->_head.get() != row_head.get()) {
+				return ExpressionRef();
+			}
+			rows.emplace_back(as_tensor<U>(row));
+			const TensorSlice<U> &tensor = rows.back();
+			const TensorSlice<U> &shape = rows.front();
+			if (tensor.rank() != shape.rank() ||
+				!std::equal(shape.dims(), shape.dims() + shape.rank(), tensor.dims())) {
+				return ExpressionRef();
+			}
+			if (tensor.rank() >= MaxTensorRank) {
+				return ExpressionRef();
+			}
+			if (tensor.rank() > 1 && tensor.row_head().get() != row_head.get()) {
+				return ExpressionRef();
+			}
+		}
+
+		const TensorSlice<U> &shape = rows.front();
+		const size_t rank = shape.rank();
+
+		std::vector<U> values;
+		values.reserve(leaves.size() * shape.element_count());
+		for (const TensorSlice<U> &tensor : rows) {
+			if (tensor.is_contiguous()) {
+				values.insert(values.end(), tensor.data(), tensor.data() + tensor.element_count());
+			} else {
+				tensor.for_each_element([&values] (const U &value) {
+					values.push_back(value);
+				});
+			}
+		}
+
+		size_t dims[MaxTensorRank];
+		index_t strides[MaxTensorRank];
+		dims[0] = leaves.size();
+		std::copy(shape.dims(), shape.dims() + rank, dims + 1);
+		contiguous_strides(rank + 1, dims, strides);
+
+		const typename PackExtent<U>::Ref extent = PackExtent<U>::construct(std::move(values));
+		return expression(head, TensorSlice<U>(extent, extent->address(), row_head, rank + 1, dims, strides));
+	}
+
+	inline bool is_all(const BaseExpressionRef &item) {
+		return item->type() == SymbolType &&
+			static_cast<const Symbol*>(item.get())->name() == "System`All";
+	}
+
+	// the 0-based position that index denotes in a list of n leaves, or -1 if there is none.
+	inline index_t position(const BaseExpressionRef &index, size_t n) {
+		if (index->type() != MachineIntegerType) {
+			return -1;
+		}
+		machine_integer_t i = static_cast<const MachineInteger*>(index.get())->value;
+		if (i < 0) {
+			i += n + 1;
+		}
+		if (i < 1 || i > machine_integer_t(n)) {
+			return -1;
+		}
+		return i - 1;
+	}
+
+	template<typename U>
+	BaseExpressionRef tensor_dimensions(const Expression *expr, const Evaluation &evaluation) {
+		const TensorSlice<U> &tensor = tensor_slice<U>(expr);
+
+		// levels below the first one only count if they have the same head as expr.
+		const size_t rank = expr->_head->same(tensor.row_head()) ? tensor.rank() : 1;
+
+		std::vector<BaseExpressionRef> dims;
+		for (size_t k = 0; k < rank; k++) {
+			dims.push_back(from_primitive(machine_integer_t(tensor.dims()[k])));
+		}
+		return expression(evaluation.definitions.List(), std::move(dims));
+	}
+
+	// Part on a tensor only moves the start of the view and drops dimensions, so that the
+	// result shares the tensor's extent. returns an empty ref for indices it cannot handle.
+	template<typename U>
+	BaseExpressionRef tensor_part(const Expression *expr, const BaseExpressionRef *indices, size_t n) {
+		const TensorSlice<U> &tensor = tensor_slice<U>(expr);
+		if (n > tensor.rank()) {
+			return BaseExpressionRef();
+		}
+
+		const U *begin = tensor.data();
+		size_t rank = 0;
+		size_t dims[MaxTensorRank];
+		index_t strides[MaxTensorRank];
+		bool first_all = false;
+
+		for (size_t k = 0; k < tensor.rank(); k++) {
+			const size_t dim = tensor.dims()[k];
+			const index_t stride = tensor.strides()[k];
+
+			if (k >= n || is_all(indices[k])) {
+				if (rank == 0) {
+					first_all = k == 0;
+				}
+				dims[rank] = dim;
+				strides[rank] = stride;
+				rank++;
+			} else {
+				const index_t i = position(indices[k], dim);
+				if (i < 0) {
+					return BaseExpressionRef();
+				}
+				begin += i * stride;
+			}
+		}
+
+		const BaseExpressionRef &head = first_all ? expr->_head : tensor.row_head();
+		return tensor_expression<U>(head, tensor.row_head(), tensor.extent(), begin, rank, dims, strides);
+	}
+
+	template<typename U>
+	BaseExpressionRef tensor_transpose(const Expression *expr) {
+		const TensorSlice<U> &tensor = tensor_slice<U>(expr);
+		if (tensor.rank() < 2) {
+			return BaseExpressionRef();
+		}
+
+		size_t dims[MaxTensorRank];
+		index_t strides[MaxTensorRank];
+		std::copy(tensor.dims(), tensor.dims() + tensor.rank(), dims);
+		std::copy(tensor.strides(), tensor.strides() + tensor.rank(), strides);
+		std::swap(dims[0], dims[1]);
+		std::swap(strides[0], strides[1]);
+
+		return expression(expr->_head, TensorSlice<U>(
+			tensor.extent(), tensor.data(), tensor.row_head(), tensor.rank(), dims, strides));
+	}
+
+	// merges the first levels + 1 dimensions of a tensor into one. this is a view if these
+	// dimensions are laid out without gaps, and a copy otherwise.
+	template<typename U>
+	BaseExpressionRef tensor_flatten(const Expression *expr, size_t levels) {
+		const TensorSlice<U> &tensor = tensor_slice<U>(expr);
+		if (!expr->_head->same(tensor.row_head())) {
+			return BaseExpressionRef(expr); // no level has the head of expr
+		}
+
+		const size_t rank = tensor.rank();
+		levels = std::min(levels, rank - 1);
+		if (levels == 0) {
+			return BaseExpressionRef(expr);
+		}
+
+		typename PackExtent<U>::Ref extent = tensor.extent();
+		const U *begin = tensor.data();
+		const size_t *dims = tensor.dims();
+		const index_t *strides = tensor.strides();
+
+		bool mergeable = true;
+		for (size_t k = 0; k < levels; k++) {
+			if (strides[k] != index_t(dims[k + 1]) * strides[k + 1]) {
+				mergeable = false;
+				break;
+			}
+		}
+
+		index_t copy_strides[MaxTensorRank];
+		if (!mergeable) {
+			extent = copy_elements(tensor);
+			begin = extent->address();
+			contiguous_strides(rank, dims, copy_strides);
+			strides = copy_strides;
+		}
+
+		size_t new_dims[MaxTensorRank];
+		index_t new_strides[MaxTensorRank];
+		new_dims[0] = 1;
+		for (size_t k = 0; k <= levels; k++) {
+			new_dims[0] *= dims[k];
+		}
+		new_strides[0] = strides[levels];
+		std::copy(dims + levels + 1, dims + rank, new_dims + 1);
+		std::copy(strides + levels + 1, strides + rank, new_strides + 1);
+
+		return tensor_expression<U>(
+			expr->_head, tensor.row_head(), extent, begin, rank - levels, new_dims, new_strides);
+	}
+
+	template<template<typename> class F, typename... Args>
+	inline BaseExpressionRef with_tensor(const Expression *expr, Args&&... args) {
+		switch (expr->slice_type_id()) {
+			case TensorSliceMachineIntegerCode:
+				return F<machine_integer_t>::call(expr, std::forward<Args>(args)...);
+			case TensorSliceMachineRealCode:
+				return F<machine_real_t>::call(expr, std::forward<Args>(args)...);
+			case TensorSliceMachineComplexCode:
+				return F<machine_complex_t>::call(expr, std::forward<Args>(args)...);
+			default:
+				throw std::runtime_error("expected a tensor");
+		}
+	}
+
+	template<typename U>
+	struct TensorDimensions {
+		static inline BaseExpressionRef call(const Expression *expr, const Evaluation &evaluation) {
+			return tensor_dimensions<U>(expr, evaluation);
+		}
+	};
+
+	template<typename U>
+	struct TensorPart {
+		static inline BaseExpressionRef call(const Expression *expr, const BaseExpressionRef *indices, size_t n) {
+			return tensor_part<U>(expr, indices, n);
+		}
+	};
+
+	template<typename U>
+	struct TensorTranspose {
+		static inline BaseExpressionRef call(const Expression *expr) {
+			return tensor_transpose<U>(expr);
+		}
+	};
+
+	template<typename U>
+	struct TensorFlatten {
+		static inline BaseExpressionRef call(const Expression *expr, size_t levels) {
+			return tensor_flatten<U>(expr, levels);
+		}
+	};
+
+	BaseExpressionRef part(const BaseExpressionRef &item, const BaseExpressionRef *indices, size_t n) {
+		if (n == 0) {
+			return item;
+		}
+		if (item->type() != ExpressionType) {
+			return BaseExpressionRef();
+		}
+		const Expression * const expr = static_cast<const Expression*>(item.get());
+
+		if (is_tensor_slice(expr->slice_type_id())) {
+			const BaseExpressionRef result = with_tensor<TensorPart>(expr, indices, n);
+			if (result) {
+				return result;
+			}
+		}
+
+		const BaseExpressionRef &index = indices[0];
+		if (is_all(index)) {
+			std::vector<BaseExpressionRef> leaves;
+			leaves.reserve(expr->size());
+			for (size_t i = 0; i < expr->size(); i++) {
+				BaseExpressionRef leaf = part(expr->leaf(i), indices + 1, n - 1);
+				if (!leaf) {
+					return BaseExpressionRef();
+				}
+				leaves.push_back(std::move(leaf));
+			}
+			return expression(expr->_head, std::move(leaves));
+		} else if (n == 1 && index->type() == MachineIntegerType &&
+			static_cast<const MachineInteger*>(index.get())->value == 0) {
+			return expr->_head;
+		} else {
+			const index_t i = position(index, expr->size());
+			if (i < 0) {
+				return BaseExpressionRef();
+			}
+			return part(expr->leaf(i), indices + 1, n - 1);
+		}
+	}
+
+	void flatten(const Expression *expr, const BaseExpressionRef &head, size_t levels,
+		std::vector<BaseExpressionRef> &leaves) {
+
+		const size_t size = expr->size();
+		for (size_t i = 0; i < size; i++) {
+			BaseExpressionRef leaf = expr->leaf(i);
+			if (levels > 0 && leaf->type() == ExpressionType) {
+				const Expression * const sub = static_cast<const Expression*>(leaf.get());
+				if (sub->_head->same(head)) {
+					flatten(sub, head, levels - 1, leaves);
+					continue;
+				}
+			}
+			leaves.push_back(std::move(leaf));
+		}
+	}
+}
+
+template BaseExpressionRef tensor_expression<machine_integer_t>(
+	const BaseExpressionRef&, const BaseExpressionRef&, const PackExtent<machine_integer_t>::Ref&,
+	const machine_integer_t*, size_t, const size_t*, const index_t*);
+template BaseExpressionRef tensor_expression<machine_real_t>(
+	const BaseExpressionRef&, const BaseExpressionRef&, const PackExtent<machine_real_t>::Ref&,
+	const machine_real_t*, size_t, const size_t*, const index_t*);
+template BaseExpressionRef tensor_expression<machine_complex_t>(
+	const BaseExpressionRef&, const BaseExpressionRef&, const PackExtent<machine_complex_t>::Ref&,
+	const machine_complex_t*, size_t, const size_t*, const index_t*);
+
+ExpressionRef pack_tensor(const BaseExpressionRef &head, const std::vector<BaseExpressionRef> &leaves) {
+	switch (static_cast<const Expression*>(leaves[0].get())->slice_type_id()) {
+		case PackSliceMachineIntegerCode:
+		case TensorSliceMachineIntegerCode:
+		case RangeSliceCode:
+			return pack_rows<machine_integer_t>(head, leaves);
+		case PackSliceMachineRealCode:
+		case TensorSliceMachineRealCode:
+			return pack_rows<machine_real_t>(head, leaves);
+		case PackSliceMachineComplexCode:
+		case TensorSliceMachineComplexCode:
+			return pack_rows<machine_complex_t>(head, leaves);
+		default:
+			return ExpressionRef();
+	}
+}
+
+BaseExpressionRef Dimensions(
+	const BaseExpressionRef &item,
+	const Evaluation &evaluation) {
+
+	const SymbolRef &List = evaluation.definitions.List();
+
+	if (item->type() != ExpressionType) {
+		return expression(List, {});
+	}
+	const Expression * const expr = static_cast<const Expression*>(item.get());
+
+	if (is_tensor_slice(expr->slice_type_id())) {
+		return with_tensor<TensorDimensions>(expr, evaluation);
+	}
+
+	// descend level by level, as long as all expressions on a level have the head of expr
+	// and the same number of leaves.
+	std::vector<BaseExpressionRef> dims;
+	std::vector<const Expression*> level = {expr};
+	std::vector<BaseExpressionRef> keep; // owns the expressions in level
+	while (true) {
+		const size_t size = level[0]->size();
+		for (const Expression *e : level) {
+			if (e->size() != size) {
+				return expression(List, std::move(dims));
+			}
+		}
+		dims.push_back(from_primitive(machine_integer_t(size)));
+		if (size == 0) {
+			break;
+		}
+
+		std::vector<const Expression*> next;
+		std::vector<BaseExpressionRef> next_keep;
+		for (const Expression *e : level) {
+			for (size_t i = 0; i < size; i++) {
+				BaseExpressionRef leaf = e->leaf(i);
+				if (leaf->type() != ExpressionType ||
+					!static_cast<const Expression*>(leaf.get())->_head->same(expr->_head)) {
+					return expression(List, std::move(dims));
+				}
+				next.push_back(static_cast<const Expression*>(leaf.get()));
+				next_keep.push_back(std::move(leaf));
+			}
+		}
+		level = std::move(next);
+		keep = std::move(next_keep);
+	}
+
+	return expression(List, std::move(dims));
+}
+
+BaseExpressionRef Part(
+	const BaseExpressionRef &expr,
+	const BaseExpressionRef &indices,
+	const Evaluation &evaluation) {
+
+	const Expression * const sequence = static_cast<const Expression*>(indices.get());
+	std::vector<BaseExpressionRef> items;
+	items.reserve(sequence->size());
+	for (size_t i = 0; i < sequence->size(); i++) {
+		items.push_back(sequence->leaf(i));
+	}
+	return part(expr, items.data(), items.size());
+}
+
+BaseExpressionRef Transpose(
+	const BaseExpressionRef &item,
+	const Evaluation &evaluation) {
+
+	if (item->type() != ExpressionType) {
+		return BaseExpressionRef();
+	}
+	const Expression * const expr = static_cast<const Expression*>(item.get());
+
+	if (is_tensor_slice(expr->slice_type_id())) {
+		return with_tensor<TensorTranspose>(expr);
+	}
+
+	const size_t n = expr->size();
+	if (n == 0) {
+		return item;
+	}
+
+	std::vector<BaseExpressionRef> rows;
+	rows.reserve(n);
+	for (size_t i = 0; i < n; i++) {
+		BaseExpressionRef row = expr->leaf(i);
+		if (row->type() != ExpressionType) {
+			return BaseExpressionRef();
+		}
+		rows.push_back(std::move(row));
+	}
+
+	const Expression * const first = static_cast<const Expression*>(rows[0].get());
+	const size_t m = first->size();
+	for (const BaseExpressionRef &row : rows) {
+		if (static_cast<const Expression*>(row.get())->size() != m) {
+			return BaseExpressionRef();
+		}
+	}
+
+	std::vector<BaseExpressionRef> columns;
+	columns.reserve(m);
+	for (size_t j = 0; j < m; j++) {
+		std::vector<BaseExpressionRef> column;
+		column.reserve(n);
+		for (const BaseExpressionRef &row : rows) {
+			column.push_back(static_cast<const Expression*>(row.get())->leaf(j));
+		}
+		columns.push_back(expression(first->_head, std::move(column)));
+	}
+	return expression(expr->_head, std::move(columns));
+}
+
+BaseExpressionRef Flatten(
+	const BaseExpressionRef &item,
+	const BaseExpressionRef &n,
+	const Evaluation &evaluation) {
+
+	if (item->type() != ExpressionType) {
+		return BaseExpressionRef();
+	}
+	const Expression * const expr = static_cast<const Expression*>(item.get());
+
+	size_t levels = std::numeric_limits<size_t>::max();
+	if (n) {
+		if (n->type() != MachineIntegerType) {
+			return BaseExpressionRef();
+		}
+		const machine_integer_t value = static_cast<const MachineInteger*>(n.get())->value;
+		if (value < 0) {
+			return BaseExpressionRef();
+		}
+		levels = value;
+	}
+
+	if (is_tensor_slice(expr->slice_type_id())) {
+		return with_tensor<TensorFlatten>(expr, levels);
+	} else if ((expr->type_mask() & MakeTypeMask(ExpressionType)) == 0) {
+		return item;
+	}
+
+	std::vector<BaseExpressionRef> leaves;
+	flatten(expr, expr->_head, levels, leaves);
+	return expression(expr->_head, std::move(leaves));
+}
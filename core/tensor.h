@@ -0,0 +1,312 @@
+#ifndef CMATHICS_TENSOR_H
+#define CMATHICS_TENSOR_H
+
+#include <algorithm>
+
+#include "leaves.h"
+
+// a TensorSlice<U> is a rank N (N >= 1) array of machine numbers that lives in one single
+// PackExtent<U>. its layout is given by dimensions and strides (counted in elements), so
+// that one extent can be shared by a matrix, its rows and columns, its transpose and its
+// flattened form. the leaves of a tensor of rank > 1 are its rows, which are built on
+// demand as views onto the extent; all rows have the same head, row_head().
+
+// tensors of higher rank keep their outer levels as ordinary lists of tensors.
+constexpr size_t MaxTensorRank = 4;
+
+template<typename U>
+struct TensorSliceTypeId {
+};
+
+template<>
+struct TensorSliceTypeId<machine_integer_t> {
+	static const SliceTypeId id = TensorSliceMachineIntegerCode;
+};
+
+template<>
+struct TensorSliceTypeId<machine_real_t> {
+	static const SliceTypeId id = TensorSliceMachineRealCode;
+};
+
+template<>
+struct TensorSliceTypeId<machine_complex_t> {
+	static const SliceTypeId id = TensorSliceMachineComplexCode;
+};
+
+template<typename T, typename TypeConverter>
+class StridedIterator {
+private:
+	const TypeConverter _converter;
+	const T *_ptr;
+	const index_t _stride;
+
+public:
+	inline StridedIterator(const TypeConverter &converter, const T *ptr, index_t stride) :
+		_converter(converter), _ptr(ptr), _stride(stride) {
+	}
+
+	inline auto operator*() const {
+		return _converter.convert(*_ptr);
+	}
+
+	inline bool operator==(const StridedIterator<T, TypeConverter> &other) const {
+		return _ptr == other._ptr;
+	}
+
+	inline bool operator!=(const StridedIterator<T, TypeConverter> &other) const {
+		return _ptr != other._ptr;
+	}
+
+	inline StridedIterator<T, TypeConverter> &operator++() {
+		_ptr += _stride;
+		return *this;
+	}
+};
+
+template<typename T, typename TypeConverter>
+class StridedCollection {
+private:
+	const TypeConverter _converter;
+	const T * const _data;
+	const size_t _size;
+	const index_t _stride;
+
+public:
+	using Iterator = StridedIterator<T, TypeConverter>;
+
+	inline StridedCollection(const T *data, size_t size, index_t stride, const TypeConverter &converter) :
+		_converter(converter), _data(data), _size(size), _stride(stride) {
+	}
+
+	inline Iterator begin() const {
+		return Iterator(_converter, _data, _stride);
+	}
+
+	inline Iterator end() const {
+		return Iterator(_converter, _data + _size * _stride, _stride);
+	}
+};
+
+// calls f for each element of the rank tensor at begin, in row-major order.
+template<typename U, typename F>
+void for_each_element(const U *begin, size_t rank, const size_t *dims, const index_t *strides, const F &f) {
+	const size_t n = dims[0];
+	const index_t stride = strides[0];
+	if (rank == 1) {
+		for (size_t i = 0; i < n; i++) {
+			f(begin[i * stride]);
+		}
+	} else {
+		for (size_t i = 0; i < n; i++) {
+			for_each_element(begin + i * stride, rank - 1, dims + 1, strides + 1, f);
+		}
+	}
+}
+
+template<typename U>
+class TensorSlice : public Slice<size_t, TensorSliceTypeId<U>::id> {
+public:
+	using BaseSlice = Slice<size_t, TensorSliceTypeId<U>::id>;
+
+	// only tensors of rank 1 have primitive leaves.
+	template<typename V>
+	using PrimitiveCollection = StridedCollection<U, PromotePrimitive<V>>;
+
+	using LeafCollection = IndexedCollection<TensorSlice<U>, PassBaseExpression>;
+
+private:
+	typename PackExtent<U>::Ref _extent;
+	const U * const _begin;
+	const BaseExpressionRef _row_head;
+	const size_t _rank;
+	size_t _dims[MaxTensorRank];
+	index_t _strides[MaxTensorRank];
+
+	BaseExpressionRef row(size_t i) const;
+
+public:
+	inline TensorSlice(
+		const typename PackExtent<U>::Ref &extent,
+		const U *begin,
+		const BaseExpressionRef &row_head,
+		size_t rank,
+		const size_t *dims,
+		const index_t *strides) :
+
+		BaseSlice(dims[0]),
+		_extent(extent),
+		_begin(begin),
+		_row_head(row_head),
+		_rank(rank) {
+
+		assert(rank >= 1 && rank <= MaxTensorRank);
+		std::copy(dims, dims + rank, _dims);
+		std::copy(strides, strides + rank, _strides);
+	}
+
+	inline const typename PackExtent<U>::Ref &extent() const {
+		return _extent;
+	}
+
+	inline const U *data() const {
+		return _begin;
+	}
+
+	inline const BaseExpressionRef &row_head() const {
+		return _row_head;
+	}
+
+	inline size_t rank() const {
+		return _rank;
+	}
+
+	inline const size_t *dims() const {
+		return _dims;
+	}
+
+	inline const index_t *strides() const {
+		return _strides;
+	}
+
+	inline size_t element_count() const {
+		size_t n = 1;
+		for (size_t k = 0; k < _rank; k++) {
+			n *= _dims[k];
+		}
+		return n;
+	}
+
+	// true if the elements are laid out row-major without gaps, starting at data().
+	inline bool is_contiguous() const {
+		index_t stride = 1;
+		for (size_t k = _rank; k-- > 0; ) {
+			if (_dims[k] > 1 && _strides[k] != stride) {
+				return false;
+			}
+			stride *= _dims[k];
+		}
+		return true;
+	}
+
+	template<typename F>
+	inline void for_each_element(const F &f) const {
+		::for_each_element(_begin, _rank, _dims, _strides, f);
+	}
+
+	inline TypeMask type_mask() const {
+		return _rank == 1 ? PackSliceTypeMask<U>::mask : MakeTypeMask(ExpressionType);
+	}
+
+	template<typename V>
+	inline PrimitiveCollection<V> primitives() const {
+		assert(_rank == 1);
+		return PrimitiveCollection<V>(_begin, BaseSlice::_size, _strides[0], PromotePrimitive<V>());
+	}
+
+	inline LeafCollection leaves() const {
+		return LeafCollection(this, PassBaseExpression());
+	}
+
+	inline BaseExpressionRef operator[](size_t i) const {
+		if (_rank == 1) {
+			return from_primitive(_begin[i * _strides[0]]);
+		} else {
+			return row(i);
+		}
+	}
+
+	// rows are expressions and still get allocated, only elements are borrowed.
+	template<typename F>
+	inline auto with_leaf(size_t i, const F &f) const {
+		if (_rank == 1) {
+			return with_atom(_begin[i * _strides[0]], f);
+		} else {
+			const BaseExpressionRef leaf = row(i);
+			return f(static_cast<const BaseExpression&>(*leaf));
+		}
+	}
+
+	TensorSlice<U> slice(index_t begin, index_t end = INDEX_MAX) const {
+		const size_t size = BaseSlice::_size;
+
+		if (begin < 0) {
+			begin = size - (-begin % size);
+		}
+		if (end < 0) {
+			end = size - (-end % size);
+		}
+
+		end = std::min(end, index_t(size));
+		begin = std::min(begin, end);
+
+		size_t dims[MaxTensorRank];
+		std::copy(_dims, _dims + _rank, dims);
+		dims[0] = end - begin;
+
+		return TensorSlice<U>(_extent, _begin + begin * _strides[0], _row_head, _rank, dims, _strides);
+	}
+
+	inline bool is_packed() const {
+		return true;
+	}
+
+	// tensors share their extent with all views onto it, so they are never rewritten in place.
+	inline BaseExpressionRef *mutable_refs() const {
+		return nullptr;
+	}
+
+	inline void set_type_mask(TypeMask type_mask) const {
+	}
+
+	inline RefsSlice unpack() const {
+		std::vector<BaseExpressionRef> leaves;
+		leaves.reserve(BaseSlice::_size);
+		for (auto leaf : this->leaves()) {
+			leaves.push_back(leaf);
+		}
+		return RefsSlice(std::move(leaves), type_mask());
+	}
+
+	inline const BaseExpressionRef *refs() const {
+		throw std::runtime_error("cannot get refs on TensorSlice");
+	}
+};
+
+// an expression over the rank tensor at begin in extent, where rank may be anything from 0
+// (which gives the element at begin) to MaxTensorRank. contiguous vectors become PackSlices.
+template<typename U>
+BaseExpressionRef tensor_expression(
+	const BaseExpressionRef &head,
+	const BaseExpressionRef &row_head,
+	const typename PackExtent<U>::Ref &extent,
+	const U *begin,
+	size_t rank,
+	const size_t *dims,
+	const index_t *strides);
+
+// if leaves are rows of the same shape that are packed over the same machine type and
+// have the same symbol as head, a TensorSlice expression that holds all of them, and an
+// empty ref otherwise.
+ExpressionRef pack_tensor(const BaseExpressionRef &head, const std::vector<BaseExpressionRef> &leaves);
+
+BaseExpressionRef Dimensions(
+	const BaseExpressionRef &expr,
+	const Evaluation &evaluation);
+
+// Part[expr, indices] for indices that are integers or All.
+BaseExpressionRef Part(
+	const BaseExpressionRef &expr,
+	const BaseExpressionRef &indices,
+	const Evaluation &evaluation);
+
+BaseExpressionRef Transpose(
+	const BaseExpressionRef &expr,
+	const Evaluation &evaluation);
+
+// Flatten[expr, n] for a machine integer n >= 0, or Flatten[expr] if n is an empty ref.
+BaseExpressionRef Flatten(
+	const BaseExpressionRef &expr,
+	const BaseExpressionRef &n,
+	const Evaluation &evaluation);
+
+#endif //CMATHICS_TENSOR_H
@@ -14,8 +14,10 @@ const char *type_name(Type type) {
 		    return "BigReal";
 	    case RationalType:
 		    return "Rational";
-	    case ComplexType:
-		    return "Complex";
+	    case MachineComplexType:
+		    return "MachineComplex";
+	    case BigComplexType:
+		    return "BigComplex";
 	    case ExpressionType:
 		    return "Expression";
 	    case SymbolType:
@@ -5,7 +5,9 @@
 #include <stdint.h>
 #include <functional>
 #include <vector>
+#include <complex>
 #include <cstdlib>
+#include <experimental/optional>
 #include <boost/intrusive_ptr.hpp>
 
 #include "hash.h"
@@ -25,9 +27,10 @@ enum Type : uint8_t {
 	MachineRealType = 3,
 	BigRealType = 4,
 	RationalType = 5,
-	ComplexType = 6,
+	MachineComplexType = 6,
 	ExpressionType = 7,
-	StringType = 8
+	StringType = 8,
+	BigComplexType = 9
 };
 
 constexpr Type build_extended_type(Type core, uint8_t extended) {
@@ -49,6 +52,8 @@ constexpr Type SymbolFunction = build_extended_type(SymbolType, 7);
 
 typedef uint16_t TypeMask;
 
+typedef std::experimental::optional<TypeMask> OptionalTypeMask;
+
 constexpr uint8_t CoreTypeMask = ((1 << CoreTypeBits) - 1);
 
 static_assert((1 << CoreTypeBits) == sizeof(TypeMask) * 8,
@@ -69,6 +74,7 @@ const char *type_name(Type type);
 
 typedef int64_t machine_integer_t;
 typedef double machine_real_t;
+typedef std::complex<machine_real_t> machine_complex_t;
 
 typedef int64_t match_size_t; // needs to be signed
 typedef std::tuple<match_size_t, match_size_t> match_sizes_t;
@@ -151,16 +157,26 @@ enum SliceTypeId : uint8_t {
 	PackSliceBigIntegerCode = 3,
 	PackSliceRationalCode = 4,
 	PackSliceStringCode = 5,
-	InPlaceSlice0Code = 6,
-	InPlaceSlice1Code = 7,
-	InPlaceSlice2Code = 8,
-	InPlaceSlice3Code = 9,
-	InPlaceSliceNCode = 9,
-	NumberOfSliceTypes = 10
+	PackSliceMachineComplexCode = 6,
+	InPlaceSlice0Code = 7,
+	InPlaceSlice1Code = 8,
+	InPlaceSlice2Code = 9,
+	InPlaceSlice3Code = 10,
+	InPlaceSliceNCode = 10,
+	RopeSliceCode = 11,
+	TensorSliceMachineIntegerCode = 12,
+	TensorSliceMachineRealCode = 13,
+	TensorSliceMachineComplexCode = 14,
+	RangeSliceCode = 15, // the last id that fits into the extended type bits
+	NumberOfSliceTypes = 16
 };
 
 inline bool is_pack_slice(SliceTypeId id) {
-	return id >= PackSliceMachineIntegerCode && id <= PackSliceStringCode;
+	return id >= PackSliceMachineIntegerCode && id <= PackSliceMachineComplexCode;
+}
+
+inline bool is_tensor_slice(SliceTypeId id) {
+	return id >= TensorSliceMachineIntegerCode && id <= TensorSliceMachineComplexCode;
 }
 
 inline constexpr SliceTypeId in_place_slice_type_id(size_t n) {
@@ -177,15 +193,23 @@ inline size_t in_place_slice_size(SliceTypeId code) {
 	return size_t(code) - size_t(InPlaceSlice0Code);
 }
 
+// objects with a reference count of at least ImmortalRefCount are immortal: reference
+// counting skips them, so their memory is never written to (and stays shared between forked
+// processes), and they never get freed. see ImmortalScope.
+constexpr size_t ImmortalRefCount = size_t(1) << (sizeof(size_t) * 8 - 2);
+
 class BaseExpression {
 protected:
 	const Type _extended_type;
 
+	// 0, or the id of the Heap whose intern table holds this object (see Interning).
+	uint8_t _interned;
+
 protected:
     mutable size_t _ref_count;
 
 public:
-    inline BaseExpression(Type type) : _extended_type(type), _ref_count(0) {
+    inline BaseExpression(Type type) : _extended_type(type), _interned(0), _ref_count(0) {
     }
 
     virtual ~BaseExpression() {
@@ -203,7 +227,23 @@ public:
 		return ((TypeMask)1) << type();
 	}
 
+    inline bool is_immortal() const {
+        return _ref_count >= ImmortalRefCount;
+    }
+
+    inline bool is_interned() const {
+        return _interned != 0;
+    }
+
+    // an intern table holds at most one object for each value.
+    inline bool interned_with(const BaseExpression &expr) const {
+        return _interned != 0 && _interned == expr._interned;
+    }
+
     inline bool same(const BaseExpressionRef &expr) const {
+        if (interned_with(*expr)) {
+            return this == expr.get();
+        }
         return same(*expr);
     }
 
@@ -269,16 +309,22 @@ public:
 
 	friend void intrusive_ptr_add_ref(const BaseExpression *expr);
     friend void intrusive_ptr_release(const BaseExpression *expr);
+
+	friend class Heap; // links released objects through _ref_count
 };
 
 #include "heap.h"
 
+// immediates are immortal as well.
+
 inline void intrusive_ptr_add_ref(const BaseExpression *expr) {
-    ++expr->_ref_count;
+    if (expr->_ref_count < ImmortalRefCount) {
+        ++expr->_ref_count;
+    }
 }
 
 inline void intrusive_ptr_release(const BaseExpression *expr) {
-    if(--expr->_ref_count == 0) {
+    if (expr->_ref_count < ImmortalRefCount && --expr->_ref_count == 0) {
         Heap::release(const_cast<BaseExpression*>(expr));
     }
 }
@@ -302,15 +348,66 @@ class OperationsInterface :
 	virtual public StructureOperations {
 };
 
+// a Bloom filter over symbols: if (filter & symbol_filter(s)) == 0, then s is not among the
+// symbols the filter was built from. system symbols with an extended type (e.g. Slot) get a
+// bit of their own (1 to 15), all others share bits 16 to 63.
+
+typedef uint64_t SymbolFilter;
+
+inline SymbolFilter symbol_filter(const BaseExpression *symbol) {
+	const uint8_t extended = symbol->extended_type() >> CoreTypeBits;
+	if (extended != 0) {
+		return SymbolFilter(1) << extended;
+	} else {
+		const uint64_t mixed = (uint64_t(uintptr_t(symbol)) >> 4) * 0x9e3779b97f4a7c15ULL;
+		return SymbolFilter(1) << (16 + (mixed >> 32) % 48);
+	}
+}
+
+// structural facts about an expression and everything below it. depth and leaf_count follow
+// Depth[] (heads do not count) and LeafCount[] (heads do count).
+
+struct ExpressionMetadata {
+	hash_t hash;
+	SymbolFilter symbols;
+	size_t leaf_count;
+	size_t depth;
+};
+
 class Expression : public BaseExpression, virtual public OperationsInterface {
 private:
 	const void *_slice_ptr;
 
+	mutable ExpressionMetadata _metadata;
+	mutable bool _has_metadata;
+
+protected:
+	virtual void compute_metadata(ExpressionMetadata &metadata) const = 0;
+
 public:
 	const BaseExpressionRef _head;
 
 	inline Expression(const BaseExpressionRef &head, SliceTypeId slice_id, const void *slice_ptr) :
-		BaseExpression(build_extended_type(ExpressionType, slice_id)), _head(head), _slice_ptr(slice_ptr) {
+		BaseExpression(build_extended_type(ExpressionType, slice_id)), _head(head), _slice_ptr(slice_ptr),
+		_has_metadata(false) {
+	}
+
+	// computed on first use and then cached.
+	inline const ExpressionMetadata &metadata() const {
+		if (!_has_metadata) {
+			compute_metadata(_metadata);
+			_has_metadata = true;
+		}
+		return _metadata;
+	}
+
+	inline bool has_metadata() const {
+		return _has_metadata;
+	}
+
+	// needs to be called whenever leaves get rewritten in place.
+	inline void invalidate_metadata() const {
+		_has_metadata = false;
 	}
 
 	inline SliceTypeId slice_type_id() const {
@@ -321,6 +418,9 @@ public:
 
 	virtual BaseExpressionRef leaf(size_t i) const = 0;
 
+	// leaf(i)->same(item), but without allocating leaf i if it is packed.
+	virtual bool same_leaf(size_t i, const BaseExpression &item) const = 0;
+
 	virtual TypeMask type_mask() const = 0;
 
 	virtual BaseExpressionRef head() const {
@@ -335,8 +435,10 @@ public:
 		return _head->extended_type() == SymbolSequence;
 	}
 
+	// if unique is set, nobody but the caller references self, so that evaluation may
+	// rewrite the leaves of self in place instead of copying them.
 	BaseExpressionRef evaluate_expression(
-		const BaseExpressionRef &self, const Evaluation &evaluation) const;
+		const BaseExpressionRef &self, bool unique, const Evaluation &evaluation) const;
 
 	virtual BaseExpressionRef evaluate_expression_with_non_symbol_head(
 		const ExpressionRef &self, const Evaluation &evaluation) const = 0;
@@ -0,0 +1,326 @@
+#include <algorithm>
+#include <string.h>
+
+#include "vectorized.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CMATHICS_HAVE_AVX2_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace {
+    // blocks this small fit into L1, and summing them sequentially keeps the error low.
+    constexpr size_t PairwiseBlockSize = 1024;
+
+    // with at most this many values per batch, none of the 64-bit lanes used by
+    // sum_integers_avx2() can overflow.
+    constexpr size_t IntegerBatchSize = size_t(1) << 30;
+
+    machine_real_t sum_block_scalar(const machine_real_t *data, size_t n) {
+        // independent accumulators, as the compiler may not reorder floating point additions.
+        machine_real_t s0 = 0., s1 = 0., s2 = 0., s3 = 0.;
+
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            s0 += data[i];
+            s1 += data[i + 1];
+            s2 += data[i + 2];
+            s3 += data[i + 3];
+        }
+        for (; i < n; i++) {
+            s0 += data[i];
+        }
+
+        return (s0 + s1) + (s2 + s3);
+    }
+
+    machine_complex_t sum_complex_block_scalar(const machine_complex_t *data, size_t n) {
+        machine_real_t re0 = 0., im0 = 0., re1 = 0., im1 = 0.;
+
+        size_t i = 0;
+        for (; i + 2 <= n; i += 2) {
+            re0 += data[i].real();
+            im0 += data[i].imag();
+            re1 += data[i + 1].real();
+            im1 += data[i + 1].imag();
+        }
+        for (; i < n; i++) {
+            re0 += data[i].real();
+            im0 += data[i].imag();
+        }
+
+        return machine_complex_t(re0 + re1, im0 + im1);
+    }
+
+    __int128 sum_integers_scalar(const machine_integer_t *data, size_t n) {
+        __int128 sum = 0;
+        for (size_t i = 0; i < n; i++) {
+            sum += data[i];
+        }
+        return sum;
+    }
+
+    constexpr uint64_t LeafHashFactor2 = LeafHashFactor * LeafHashFactor;
+    constexpr uint64_t LeafHashFactor4 = LeafHashFactor2 * LeafHashFactor2;
+
+    // h0 K^3 + h1 K^2 + h2 K + h3, i.e. four lanes of hash_leaf() merged into one.
+    inline hash_t merge_hash_lanes(uint64_t h0, uint64_t h1, uint64_t h2, uint64_t h3) {
+        return hash_leaf(hash_leaf(hash_leaf(h0, h1), h2), h3);
+    }
+
+    template<typename T, typename F>
+    hash_t hash_scalar(const T *data, size_t n, const F &hash) {
+        // four independent chains of hash_leaf(), each stepping over four leaves at once.
+        uint64_t h0 = 0, h1 = 0, h2 = 0, h3 = 0;
+
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            h0 = h0 * LeafHashFactor4 + hash(data[i]);
+            h1 = h1 * LeafHashFactor4 + hash(data[i + 1]);
+            h2 = h2 * LeafHashFactor4 + hash(data[i + 2]);
+            h3 = h3 * LeafHashFactor4 + hash(data[i + 3]);
+        }
+
+        hash_t result = merge_hash_lanes(h0, h1, h2, h3);
+        for (; i < n; i++) {
+            result = hash_leaf(result, hash(data[i]));
+        }
+        return result;
+    }
+
+
+#if CMATHICS_HAVE_AVX2_KERNELS
+    __attribute__((target("avx2")))
+    machine_real_t sum_block_avx2(const machine_real_t *data, size_t n) {
+        __m256d s0 = _mm256_setzero_pd();
+        __m256d s1 = _mm256_setzero_pd();
+        __m256d s2 = _mm256_setzero_pd();
+        __m256d s3 = _mm256_setzero_pd();
+
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            s0 = _mm256_add_pd(s0, _mm256_loadu_pd(data + i));
+            s1 = _mm256_add_pd(s1, _mm256_loadu_pd(data + i + 4));
+            s2 = _mm256_add_pd(s2, _mm256_loadu_pd(data + i + 8));
+            s3 = _mm256_add_pd(s3, _mm256_loadu_pd(data + i + 12));
+        }
+        for (; i + 4 <= n; i += 4) {
+            s0 = _mm256_add_pd(s0, _mm256_loadu_pd(data + i));
+        }
+
+        const __m256d s = _mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3));
+        alignas(32) machine_real_t lanes[4];
+        _mm256_store_pd(lanes, s);
+
+        machine_real_t tail = 0.;
+        for (; i < n; i++) {
+            tail += data[i];
+        }
+
+        return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + tail;
+    }
+
+    __attribute__((target("avx2")))
+    machine_complex_t sum_complex_block_avx2(const machine_complex_t *data, size_t n) {
+        // std::complex is laid out as {real, imag}, so each vector holds two complex values,
+        // with the real parts in the even and the imaginary parts in the odd lanes.
+        const machine_real_t * const values = reinterpret_cast<const machine_real_t*>(data);
+        const size_t m = 2 * n;
+
+        __m256d s0 = _mm256_setzero_pd();
+        __m256d s1 = _mm256_setzero_pd();
+        __m256d s2 = _mm256_setzero_pd();
+        __m256d s3 = _mm256_setzero_pd();
+
+        size_t i = 0;
+        for (; i + 16 <= m; i += 16) {
+            s0 = _mm256_add_pd(s0, _mm256_loadu_pd(values + i));
+            s1 = _mm256_add_pd(s1, _mm256_loadu_pd(values + i + 4));
+            s2 = _mm256_add_pd(s2, _mm256_loadu_pd(values + i + 8));
+            s3 = _mm256_add_pd(s3, _mm256_loadu_pd(values + i + 12));
+        }
+        for (; i + 4 <= m; i += 4) {
+            s0 = _mm256_add_pd(s0, _mm256_loadu_pd(values + i));
+        }
+
+        const __m256d s = _mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3));
+        alignas(32) machine_real_t lanes[4];
+        _mm256_store_pd(lanes, s);
+
+        machine_real_t re = lanes[0] + lanes[2];
+        machine_real_t im = lanes[1] + lanes[3];
+        for (; i < m; i += 2) {
+            re += values[i];
+            im += values[i + 1];
+        }
+
+        return machine_complex_t(re, im);
+    }
+
+    __attribute__((target("avx2")))
+    __int128 sum_integers_avx2(const machine_integer_t *data, size_t n) {
+        // each value x is split into its unsigned high and low 32 bits and its sign, so that
+        // x = hi * 2^32 + lo - sign * 2^64. the three parts are summed up separately in 64-bit
+        // lanes, which cannot overflow within one batch.
+
+        const __m256i low_mask = _mm256_set1_epi64x(0xffffffff);
+
+        __int128 sum = 0;
+        size_t i = 0;
+
+        while (n - i >= 4) {
+            const size_t end = i + std::min(n - i, IntegerBatchSize) / 4 * 4;
+
+            __m256i hi = _mm256_setzero_si256();
+            __m256i lo = _mm256_setzero_si256();
+            __m256i sign = _mm256_setzero_si256();
+
+            for (; i < end; i += 4) {
+                const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                hi = _mm256_add_epi64(hi, _mm256_srli_epi64(x, 32));
+                lo = _mm256_add_epi64(lo, _mm256_and_si256(x, low_mask));
+                sign = _mm256_add_epi64(sign, _mm256_srli_epi64(x, 63));
+            }
+
+            alignas(32) uint64_t hi_lanes[4], lo_lanes[4], sign_lanes[4];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(hi_lanes), hi);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lo_lanes), lo);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(sign_lanes), sign);
+
+            const uint64_t hi_sum = hi_lanes[0] + hi_lanes[1] + hi_lanes[2] + hi_lanes[3];
+            const uint64_t lo_sum = lo_lanes[0] + lo_lanes[1] + lo_lanes[2] + lo_lanes[3];
+            const uint64_t sign_sum = sign_lanes[0] + sign_lanes[1] + sign_lanes[2] + sign_lanes[3];
+
+            sum += (static_cast<__int128>(hi_sum) << 32) + static_cast<__int128>(lo_sum) -
+                (static_cast<__int128>(sign_sum) << 64);
+        }
+
+        return sum + sum_integers_scalar(data + i, n - i);
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i mullo_epi64_avx2(__m256i a, __m256i b) {
+        // AVX2 only multiplies 32-bit halves: a * b = lo(a) lo(b) + (hi(a) lo(b) + lo(a) hi(b)) 2^32.
+        const __m256i cross = _mm256_add_epi64(
+            _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+            _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+        return _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(cross, 32));
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i hash_mix_avx2(__m256i x) {
+        // see hash_mix().
+        const __m256i c1 = _mm256_set1_epi64x(0xff51afd7ed558ccdULL);
+        const __m256i c2 = _mm256_set1_epi64x(0xc4ceb9fe1a85ec53ULL);
+        x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 33));
+        x = mullo_epi64_avx2(x, c1);
+        x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 33));
+        x = mullo_epi64_avx2(x, c2);
+        return _mm256_xor_si256(x, _mm256_srli_epi64(x, 33));
+    }
+
+    // hash_scalar() over the 64-bit words at data, with lane j of h holding the chain for
+    // leaves j, j + 4, j + 8, ... words are real_bits() of doubles if Reals is set.
+    template<bool Reals>
+    __attribute__((target("avx2")))
+    hash_t hash_words_avx2(const uint64_t *data, size_t n, uint64_t seed, hash_t (*hash)(uint64_t)) {
+        const __m256i factor = _mm256_set1_epi64x(LeafHashFactor4);
+        const __m256i seeds = _mm256_set1_epi64x(seed);
+        const __m256i sign = _mm256_set1_epi64x(0x8000000000000000ULL);
+
+        __m256i h = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            if (Reals) {
+                // see real_bits(): -0. becomes 0.
+                const __m256i zero = _mm256_cmpeq_epi64(_mm256_andnot_si256(sign, x), _mm256_setzero_si256());
+                x = _mm256_andnot_si256(zero, x);
+            }
+            h = _mm256_add_epi64(mullo_epi64_avx2(h, factor), hash_mix_avx2(_mm256_xor_si256(x, seeds)));
+        }
+
+        alignas(32) uint64_t lanes[4];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), h);
+
+        hash_t result = merge_hash_lanes(lanes[0], lanes[1], lanes[2], lanes[3]);
+        for (; i < n; i++) {
+            result = hash_leaf(result, hash(data[i]));
+        }
+        return result;
+    }
+
+    hash_t hash_integer_word(uint64_t x) {
+        return hash_machine_integer(int64_t(x));
+    }
+
+    hash_t hash_real_word(uint64_t x) {
+        double value;
+        memcpy(&value, &x, sizeof(value));
+        return hash_machine_real(value);
+    }
+
+    inline bool has_avx2() {
+        static const bool avx2 = __builtin_cpu_supports("avx2");
+        return avx2;
+    }
+#endif
+
+    template<typename T, typename F>
+    T sum_pairwise(const T *data, size_t n, const F &sum_block) {
+        if (n <= PairwiseBlockSize) {
+            return sum_block(data, n);
+        } else {
+            const size_t half = n / 2;
+            return sum_pairwise(data, half, sum_block) + sum_pairwise(data + half, n - half, sum_block);
+        }
+    }
+}
+
+machine_real_t sum_machine_reals(const machine_real_t *data, size_t n) {
+#if CMATHICS_HAVE_AVX2_KERNELS
+    if (has_avx2()) {
+        return sum_pairwise(data, n, sum_block_avx2);
+    }
+#endif
+    return sum_pairwise(data, n, sum_block_scalar);
+}
+
+machine_complex_t sum_machine_complexes(const machine_complex_t *data, size_t n) {
+    static_assert(sizeof(machine_complex_t) == 2 * sizeof(machine_real_t), "unexpected layout of std::complex");
+#if CMATHICS_HAVE_AVX2_KERNELS
+    if (has_avx2()) {
+        return sum_pairwise(data, n, sum_complex_block_avx2);
+    }
+#endif
+    return sum_pairwise(data, n, sum_complex_block_scalar);
+}
+
+hash_t hash_machine_integers(const machine_integer_t *data, size_t n) {
+#if CMATHICS_HAVE_AVX2_KERNELS
+    if (has_avx2()) {
+        return hash_words_avx2<false>(reinterpret_cast<const uint64_t*>(data), n,
+            machine_integer_hash, hash_integer_word);
+    }
+#endif
+    return hash_scalar(data, n, hash_machine_integer);
+}
+
+hash_t hash_machine_reals(const machine_real_t *data, size_t n) {
+#if CMATHICS_HAVE_AVX2_KERNELS
+    if (has_avx2()) {
+        return hash_words_avx2<true>(reinterpret_cast<const uint64_t*>(data), n,
+            machine_real_hash, hash_real_word);
+    }
+#endif
+    return hash_scalar(data, n, hash_machine_real);
+}
+
+__int128 sum_machine_integers(const machine_integer_t *data, size_t n) {
+#if CMATHICS_HAVE_AVX2_KERNELS
+    if (has_avx2()) {
+        return sum_integers_avx2(data, n);
+    }
+#endif
+    return sum_integers_scalar(data, n);
+}
@@ -0,0 +1,26 @@
+#ifndef CMATHICS_VECTORIZED_H
+#define CMATHICS_VECTORIZED_H
+
+#include <stddef.h>
+
+#include "types.h"
+
+// reductions over packed machine values (see PackSlice). on x86-64, an AVX2 implementation
+// gets picked at runtime if the CPU supports it, otherwise a portable scalar one is used.
+
+// sums pairwise over blocks, so the rounding error grows with log(n) instead of n.
+machine_real_t sum_machine_reals(const machine_real_t *data, size_t n);
+
+// sums real and imaginary parts separately, like sum_machine_reals().
+machine_complex_t sum_machine_complexes(const machine_complex_t *data, size_t n);
+
+// the exact sum, which cannot overflow for any n that fits into memory.
+__int128 sum_machine_integers(const machine_integer_t *data, size_t n);
+
+// the hash of the leaves hash_machine_integer(data[i]), as computed by hash_leaf().
+hash_t hash_machine_integers(const machine_integer_t *data, size_t n);
+
+// the hash of the leaves hash_machine_real(data[i]), as computed by hash_leaf().
+hash_t hash_machine_reals(const machine_real_t *data, size_t n);
+
+#endif //CMATHICS_VECTORIZED_H
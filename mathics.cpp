@@ -3,6 +3,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <gmp.h>
 #include <iostream>
 #include <sstream>
@@ -17,6 +22,10 @@
 #include "core/integer.h"
 #include "core/real.h"
 #include "core/rational.h"
+#include "core/complex.h"
+#include "core/rope.h"
+#include "core/tensor.h"
+#include "core/mapped.h"
 #include "core/arithmetic.h"
 #include "core/string.h"
 #include "core/builtin.h"
@@ -211,6 +220,10 @@ namespace python {
             return list_iterator(_py_object, PyList_Size(_py_object));
         }
 
+        inline size_t size() const {
+            return PyList_Size(_py_object);
+        }
+
         inline object operator[](size_t i) const {
             PyObject *item;
             if (PyTuple_Check(_py_object)) {
@@ -387,6 +400,21 @@ public:
         _string(python::string("String")) {
     }
 
+    // like convert(), but machine numbers go into leaves without getting boxed first.
+    void convert_leaf(const python::object &o, adaptive_storage &leaves) {
+        auto kind = o[0];
+
+        if (kind == _integer) {
+            mpz_class x;
+            o[1].as_integer(x);
+            leaves << x;
+        } else if (kind == _machine_real) {
+            leaves << o[1].as_float();
+        } else {
+            leaves << convert(o);
+        }
+    }
+
     BaseExpressionRef convert(const python::object &o) {
         auto kind = o[0];
 
@@ -408,13 +436,14 @@ public:
             return from_primitive(o[1].as_float());
         } else if (kind == _expression) {
 	        auto head = convert(o[1]);
-	        std::vector<BaseExpressionRef> leaves;
+	        auto items = o[2];
+	        adaptive_storage leaves(items.size());
 
-	        for (auto leaf : o[2]) {
-		        leaves.push_back(convert(leaf));
+	        for (auto leaf : items) {
+		        convert_leaf(leaf, leaves);
 	        }
 
-	        return expression(head, std::move(leaves));
+	        return leaves.to_expression(head);
         } else if (kind == _string) {
 	        return from_primitive(o[1].as_string());
         } else {
@@ -527,6 +556,10 @@ public:
 	}
 
     void initialize() {
+        // everything set up here lives as long as the process, and is shared by all workers
+        // of a fork server.
+        ImmortalScope immortal;
+
         add("Plus",
             Attributes::None, {
             rule(
@@ -591,6 +624,65 @@ public:
 	            )
             });
 
+	    add("Append",
+	        Attributes::None, {
+		        rule<2>(
+			        "Append[expr_, item_]",
+			        [](const BaseExpressionRef &expr, const BaseExpressionRef &item, const Evaluation &evaluation) {
+				        if (expr->type() != ExpressionType) {
+					        return BaseExpressionRef();
+				        }
+				        const Expression * const list = static_cast<const Expression*>(expr.get());
+				        return BaseExpressionRef(concatenate(list, expression(list->_head, {item}).get()));
+			        }
+		        )
+	        });
+
+	    add("Prepend",
+	        Attributes::None, {
+		        rule<2>(
+			        "Prepend[expr_, item_]",
+			        [](const BaseExpressionRef &expr, const BaseExpressionRef &item, const Evaluation &evaluation) {
+				        if (expr->type() != ExpressionType) {
+					        return BaseExpressionRef();
+				        }
+				        const Expression * const list = static_cast<const Expression*>(expr.get());
+				        return BaseExpressionRef(concatenate(expression(list->_head, {item}).get(), list));
+			        }
+		        )
+	        });
+
+	    add("Join",
+	        Attributes::None, {
+		        rule<1>(
+			        "Join[lists___]",
+			        [](const BaseExpressionRef &lists, const Evaluation &evaluation) {
+				        const Expression * const sequence = static_cast<const Expression*>(lists.get());
+				        const size_t n = sequence->size();
+				        if (n == 0) {
+					        return BaseExpressionRef(expression(evaluation.definitions.List(), {}));
+				        }
+				        BaseExpressionRef joined = sequence->leaf(0);
+				        if (joined->type() != ExpressionType) {
+					        return BaseExpressionRef();
+				        }
+				        for (size_t i = 1; i < n; i++) {
+					        const BaseExpressionRef next = sequence->leaf(i);
+					        if (next->type() != ExpressionType) {
+						        return BaseExpressionRef();
+					        }
+					        const Expression * const a = static_cast<const Expression*>(joined.get());
+					        const Expression * const b = static_cast<const Expression*>(next.get());
+					        if (!a->_head->same(b->_head)) {
+						        return BaseExpressionRef();
+					        }
+					        joined = concatenate(a, b);
+				        }
+				        return joined;
+			        }
+		        )
+	        });
+
         add("Range",
             Attributes::None, {
 		        rewrite("Range[imax_]", "Range[1, imax, 1]"),
@@ -612,6 +704,83 @@ public:
 		        rewrite("Total[head_, n_]", "Apply[Plus, Flatten[head, n]]"),
 	        });
 
+	    add("Dimensions",
+	        Attributes::None, {
+		        rule<1>(
+			        "Dimensions[expr_]",
+			        Dimensions
+		        )
+	        });
+
+	    add("Depth",
+	        Attributes::None, {
+		        rule<1>(
+			        "Depth[expr_]",
+			        Depth
+		        )
+	        });
+
+	    add("LeafCount",
+	        Attributes::None, {
+		        rule<1>(
+			        "LeafCount[expr_]",
+			        LeafCount
+		        )
+	        });
+
+	    add("Part",
+	        Attributes::None, {
+		        rule<2>(
+			        "Part[expr_, i___]",
+			        Part
+		        )
+	        });
+
+	    add("Transpose",
+	        Attributes::None, {
+		        rule<1>(
+			        "Transpose[m_]",
+			        Transpose
+		        )
+	        });
+
+	    add("Flatten",
+	        Attributes::None, {
+		        rule<1>(
+			        "Flatten[expr_]",
+			        [](const BaseExpressionRef &expr, const Evaluation &evaluation) {
+				        return Flatten(expr, BaseExpressionRef(), evaluation);
+			        }
+		        ),
+		        rule<2>(
+			        "Flatten[expr_, n_]",
+			        Flatten
+		        )
+	        });
+
+	    add("Complex",
+	        Attributes::None, {
+		        rule<2>(
+			        "Complex[re_, im_]",
+			        [](const BaseExpressionRef &re, const BaseExpressionRef &im, const Evaluation &evaluation) {
+				        return complex(re, im);
+			        }
+		        )
+	        });
+
+	    add("BinaryReadList",
+	        Attributes::None, {
+		        rule<2>(
+			        "BinaryReadList[file_, type_]",
+			        BinaryReadList
+		        )
+	        });
+
+	    add("Import",
+	        Attributes::None, {
+		        rewrite("Import[file_, {\"Binary\", type_}]", "BinaryReadList[file, type]")
+	        });
+
 	    add("Timing",
 	        Attributes::HoldAll, {
 		        rule<1>(
@@ -629,6 +798,36 @@ public:
 		        )
 	        });
 
+	    add("MemoryInUse",
+	        Attributes::None, {
+		        rule<0>(
+			        "MemoryInUse[]",
+			        [](const Evaluation &evaluation) {
+				        return from_primitive(static_cast<machine_integer_t>(Heap::memory_in_use()));
+			        }
+		        )
+	        });
+
+	    add("MaxMemoryUsed",
+	        Attributes::None, {
+		        rule<0>(
+			        "MaxMemoryUsed[]",
+			        [](const Evaluation &evaluation) {
+				        return from_primitive(static_cast<machine_integer_t>(Heap::max_memory_used()));
+			        }
+		        )
+	        });
+
+	    add("ByteCount",
+	        Attributes::None, {
+		        rule<1>(
+			        "ByteCount[expr_]",
+			        [](const BaseExpressionRef &expr, const Evaluation &evaluation) {
+				        return from_primitive(static_cast<machine_integer_t>(Heap::byte_count(expr)));
+			        }
+		        )
+	        });
+
 	    add("Function",
 	        Attributes::HoldAll, {
 		        rule<2>(
@@ -649,6 +848,8 @@ public:
 		        )
 	        }
 	    );
+
+	    _definitions.make_immortal();
     }
 };
 
@@ -676,7 +877,7 @@ void pattern_test() {
         x, expression(definitions.lookup("System`Blank"), {})
     });
 
-    Match m1 = match(patt, from_primitive(7LL), definitions);
+    Match m1 = match(patt, from_primitive(machine_integer_t(7)), definitions);
     std::cout << m1 << std::endl;
 
     patt = expression(definitions.lookup("System`Pattern"), {
@@ -684,16 +885,13 @@ void pattern_test() {
     });
 
     auto some_expr = expression(definitions.lookup("System`Sequence"), {
-		from_primitive(1LL), from_primitive(3LL)});
+		from_primitive(machine_integer_t(1)), from_primitive(machine_integer_t(3))});
 
     Match m2 = match(patt, some_expr, definitions);
     std::cout << m2 << std::endl;
 }
 
-void mini_console() {
-    Runtime runtime;
-    runtime.initialize();
-
+void mini_console(Runtime &runtime) {
     std::cout << ">> ";
     for (std::string line; std::getline(std::cin, line);) {
 	    if (line.empty()) {
@@ -715,13 +913,84 @@ void mini_console() {
     }
 }
 
-int main() {
+// serves a mini console on each connection to the unix domain socket at path. every connection
+// gets a worker process of its own, forked from the already initialized runtime, whose memory
+// the workers share (copy-on-write).
+
+void fork_server(Runtime &runtime, const char *path) {
+    sockaddr_un address;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        throw std::runtime_error(string_format("socket path %s is too long", path));
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    const int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (server < 0 ||
+        bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+        listen(server, SOMAXCONN) < 0) {
+        throw std::runtime_error(string_format("cannot listen on %s: %s", path, strerror(errno)));
+    }
+
+    signal(SIGCHLD, SIG_IGN); // workers get reaped automatically
+    std::cout.flush(); // or workers would write it again
+
+    while (true) {
+        const int connection = accept(server, nullptr, nullptr);
+        if (connection < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(string_format("accept failed: %s", strerror(errno)));
+        }
+
+        const pid_t pid = fork();
+        if (pid == 0) {
+#if PY_VERSION_HEX >= 0x03070000
+            PyOS_AfterFork_Child();
+#else
+            PyOS_AfterFork();
+#endif
+            close(server);
+            dup2(connection, STDIN_FILENO);
+            dup2(connection, STDOUT_FILENO);
+            close(connection);
+
+            mini_console(runtime);
+
+            // tearing down the runtime would only write to pages we share with the server.
+            std::cout.flush();
+            _exit(0);
+        }
+
+        close(connection);
+        if (pid < 0) {
+            throw std::runtime_error(string_format("fork failed: %s", strerror(errno)));
+        }
+    }
+}
+
+int main(int argc, char **argv) {
     Heap::init();
 	EvaluateDispatch::init();
 
     python::Context context;
 
-    mini_console();
+    Runtime runtime;
+    runtime.initialize();
+
+    if (argc == 3 && strcmp(argv[1], "--fork-server") == 0) {
+        try {
+            fork_server(runtime, argv[2]);
+        } catch (const std::runtime_error &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    } else {
+        mini_console(runtime);
+    }
 
     return 0;
 }
@@ -1,6 +1,10 @@
 #include <gtest/gtest.h>
 
+#include "core/types.h"
+#include "core/expression.h"
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
+    EvaluateDispatch::init();
     return RUN_ALL_TESTS();
 }
@@ -7,23 +7,23 @@
 #include "core/integer.h"
 #include "core/arithmetic.h"
 #include "core/definitions.h"
+#include "core/expression.h"
+#include "core/evaluation.h"
 
 
 TEST(Arithmetic, Plus) {
     // initialize arguments
-    BaseExpressionRef a = std::make_shared<MachineInteger>(1);
-    BaseExpressionRef b = std::make_shared<MachineInteger>(2);
+    BaseExpressionRef a = Heap::MachineInteger(1);
+    BaseExpressionRef b = Heap::MachineInteger(2);
 
     // get plus head
-    Definitions* definitions = new Definitions(); // System Definitions
-    auto plus_head = definitions->lookup("Plus");
+    Definitions definitions; // System Definitions
+    auto plus_head = definitions.lookup("System`Plus");
 
     // construct expression
-    ExpressionRef plus_expr = ExpressionRef(new Expression(plus_head, {a, b}));
+    ExpressionRef plus_expr = expression(plus_head, {a, b});
 
-    BaseExpressionRef result_expr = _Plus(plus_expr);
+    BaseExpressionRef result_expr = Plus(plus_expr, Evaluation(definitions, false, false));
     ASSERT_EQ(result_expr->type(), MachineIntegerType);
-    EXPECT_EQ(std::static_pointer_cast<const MachineInteger>(result_expr)->value, 3);
+    EXPECT_EQ(boost::static_pointer_cast<const MachineInteger>(result_expr)->value, 3);
 }
-
-
@@ -0,0 +1,56 @@
+#include <stdlib.h>
+#include <gtest/gtest.h>
+
+#include "core/types.h"
+#include "core/complex.h"
+#include "core/expression.h"
+
+
+TEST(MachineComplex, MachineComplex_init) {
+    MachineComplex p(machine_complex_t(1.5, -2.));
+    EXPECT_EQ(p.type(), MachineComplexType);
+    EXPECT_EQ(p.value, machine_complex_t(1.5, -2.));
+    EXPECT_TRUE(p.same(MachineComplex(machine_complex_t(1.5, -2.))));
+    EXPECT_FALSE(p.same(MachineComplex(machine_complex_t(1.5, 2.))));
+}
+
+
+TEST(MachineComplex, complex) {
+    const BaseExpressionRef z = complex(
+        from_primitive(machine_integer_t(1)), from_primitive(machine_real_t(0.5)));
+    ASSERT_TRUE(z);
+    ASSERT_EQ(z->type(), MachineComplexType);
+    EXPECT_EQ(static_cast<const MachineComplex*>(z.get())->value, machine_complex_t(1., 0.5));
+
+    // no exact complex numbers yet.
+    EXPECT_FALSE(complex(from_primitive(machine_integer_t(1)), from_primitive(machine_integer_t(2))));
+}
+
+
+TEST(MachineComplex, packed) {
+    const BaseExpressionRef head = from_primitive(std::string("Plus"));
+
+    std::vector<BaseExpressionRef> leaves;
+    for (int i = 0; i < 100; i++) {
+        leaves.push_back(from_primitive(machine_complex_t(i, -2. * i)));
+    }
+    const ExpressionRef sum = expression(head, std::move(leaves));
+    EXPECT_EQ(sum->slice_type_id(), PackSliceMachineComplexCode);
+    EXPECT_EQ(sum->leaf(3)->type(), MachineComplexType);
+
+    const BaseExpressionRef result = sum->add_only_machine_complexes();
+    ASSERT_EQ(result->type(), MachineComplexType);
+    EXPECT_EQ(static_cast<const MachineComplex*>(result.get())->value, machine_complex_t(4950., -9900.));
+}
+
+
+TEST(MachineComplex, inexact) {
+    const BaseExpressionRef head = from_primitive(std::string("Plus"));
+
+    const ExpressionRef sum = expression(head, {
+        from_primitive(machine_real_t(0.5)), from_primitive(machine_complex_t(1., 2.)),
+        from_primitive(machine_integer_t(3))});
+    const BaseExpressionRef result = sum->add_machine_inexact();
+    ASSERT_EQ(result->type(), MachineComplexType);
+    EXPECT_EQ(static_cast<const MachineComplex*>(result.get())->value, machine_complex_t(4.5, 2.));
+}
@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <gtest/gtest.h>
+
+#include "core/types.h"
+#include "core/expression.h"
+#include "core/definitions.h"
+#include "core/evaluation.h"
+#include "core/evaluate.h"
+#include "core/misc.h"
+
+
+namespace {
+    ExpressionRef unevaluated_list(Definitions &definitions, const SymbolRef &f, size_t n) {
+        // List[f[0], f[1], ...]
+        std::vector<BaseExpressionRef> leaves;
+        for (size_t i = 0; i < n; i++) {
+            leaves.push_back(expression(f, {from_primitive(machine_integer_t(i))}));
+        }
+        return expression(definitions.List(), std::move(leaves));
+    }
+}
+
+
+TEST(Evaluate, in_place) {
+    Definitions definitions;
+
+    const SymbolRef f = definitions.lookup("Global`inPlaceF");
+    f->add_down_rule([] (const ExpressionRef &expr, const Evaluation &evaluation) {
+        return expr->leaf(0);
+    });
+
+    const Expression *created = nullptr;
+    ExpressionRef shared = unevaluated_list(definitions, f, 10);
+
+    const SymbolRef fresh = definitions.lookup("Global`inPlaceFresh");
+    fresh->add_down_rule([&f, &created] (const ExpressionRef &expr, const Evaluation &evaluation) {
+        const ExpressionRef list = unevaluated_list(evaluation.definitions, f, 10);
+        created = list.get();
+        return BaseExpressionRef(list);
+    });
+
+    const SymbolRef held = definitions.lookup("Global`inPlaceShared");
+    held->add_down_rule([&shared] (const ExpressionRef &expr, const Evaluation &evaluation) {
+        return BaseExpressionRef(shared);
+    });
+
+    Evaluation evaluation(definitions, false, false);
+
+    // the list only lives in the evaluation, so its leaves get rewritten in place.
+    const BaseExpressionRef result = evaluation.evaluate(expression(fresh, {}));
+    ASSERT_EQ(result->type(), ExpressionType);
+    EXPECT_EQ(result.get(), created);
+    EXPECT_EQ(result->fullform(), "System`List[0, 1, 2, 3, 4, 5, 6, 7, 8, 9]");
+    EXPECT_EQ(static_cast<const Expression*>(result.get())->type_mask(), MakeTypeMask(MachineIntegerType));
+
+    // others see this list, so it must stay as it is.
+    const BaseExpressionRef copied = evaluation.evaluate(expression(held, {}));
+    EXPECT_NE(copied.get(), shared.get());
+    EXPECT_EQ(copied->fullform(), "System`List[0, 1, 2, 3, 4, 5, 6, 7, 8, 9]");
+    EXPECT_EQ(shared->leaf(0)->type(), ExpressionType);
+}
+
+
+TEST(Evaluate, adaptive_storage) {
+    Definitions definitions;
+    const SymbolRef &List = definitions.List();
+
+    // machine integers go straight into a packed slice.
+    adaptive_storage integers(5);
+    for (machine_integer_t i = 0; i < 5; i++) {
+        integers << (1000000 + i);
+    }
+    integers << from_primitive(machine_integer_t(1000005));
+    const ExpressionRef packed = integers.to_expression(List);
+    EXPECT_EQ(packed->slice_type_id(), PackSliceMachineIntegerCode);
+    EXPECT_EQ(packed->fullform(), "System`List[1000000, 1000001, 1000002, 1000003, 1000004, 1000005]");
+
+    // the first leaf of another type turns everything into refs.
+    adaptive_storage mixed(5);
+    mixed << machine_integer_t(1) << machine_integer_t(2) << machine_integer_t(3);
+    mixed << machine_real_t(0.5) << List;
+    const ExpressionRef refs = mixed.to_expression(List);
+    EXPECT_EQ(refs->slice_type_id(), RefsSliceCode);
+    EXPECT_EQ(refs->size(), 5);
+    EXPECT_EQ(refs->leaf(3)->type(), MachineRealType);
+    EXPECT_TRUE(refs->leaf(4)->same(List));
+
+    // tiny expressions are not packed.
+    adaptive_storage reals(2);
+    reals << machine_real_t(1) << machine_real_t(2);
+    EXPECT_EQ(reals.to_expression(List)->slice_type_id(), in_place_slice_type_id(2));
+}
+
+
+TEST(Evaluate, metadata) {
+    Definitions definitions;
+    const SymbolRef f = definitions.lookup("Global`metadataF");
+    const SymbolRef x = definitions.lookup("Global`metadataX");
+    const SymbolRef slot = definitions.lookup("System`Slot");
+
+    const std::vector<machine_integer_t> values{1, 2, 3, 4};
+    const auto make = [&] () {
+        // f[f[x], {1, 2, 3, 4}]
+        return expression(f, {expression(f, {x}), expression(definitions.List(), PackSlice<machine_integer_t>(values))});
+    };
+
+    const ExpressionRef a = make();
+    const ExpressionRef b = make();
+    EXPECT_FALSE(a->has_metadata());
+
+    const ExpressionMetadata &metadata = a->metadata();
+    EXPECT_EQ(metadata.depth, 3);
+    EXPECT_EQ(metadata.leaf_count, 8);
+    EXPECT_NE(metadata.symbols & symbol_filter(x.get()), 0);
+    EXPECT_EQ(metadata.symbols & symbol_filter(slot.get()), 0);
+    EXPECT_EQ(symbol_filter(x.get()) & 0xffff, 0); // never collides with extended types
+
+    EXPECT_EQ(a->hash(), b->hash());
+    EXPECT_TRUE(a->same(b));
+    const ExpressionRef c = expression(f, {expression(f, {f}), a->leaf(1)});
+    EXPECT_NE(a->hash(), c->hash());
+    EXPECT_FALSE(a->same(c)); // rejected by hash
+
+    const BaseExpressionRef with_slot = expression(f, {expression(slot, {from_primitive(machine_integer_t(1))})});
+    EXPECT_NE(static_cast<const Expression*>(with_slot.get())->metadata().symbols & symbol_filter(slot.get()), 0);
+
+    EXPECT_EQ(Depth(x, Evaluation(definitions, false, false))->fullform(), "1");
+}
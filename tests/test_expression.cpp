@@ -1,7 +1,13 @@
 #include <gtest/gtest.h>
 
 
+#include "core/types.h"
+#include "core/integer.h"
+#include "core/rational.h"
 #include "core/expression.h"
+#include "core/definitions.h"
+#include "core/matcher.h"
+#include "core/range.h"
 
 
 /*
@@ -12,3 +18,75 @@ TEST(Symbol, new) {
     Symbol_free(s);
 }
 */
+
+
+TEST(Expression, packed_exact) {
+    const BaseExpressionRef head = from_primitive(std::string("List"));
+    const mpz_class big = mpz_class(1) << 80;
+
+    // machine and big integers get packed together.
+    const ExpressionRef integers = expression(head, std::vector<BaseExpressionRef>{
+        from_primitive(machine_integer_t(1)), from_primitive(big),
+        from_primitive(machine_integer_t(2)), from_primitive(big)});
+    EXPECT_EQ(integers->slice_type_id(), PackSliceBigIntegerCode);
+    EXPECT_EQ(integers->leaf(0)->type(), MachineIntegerType);
+    EXPECT_EQ(integers->leaf(1)->type(), BigIntegerType);
+    EXPECT_EQ(to_primitive<mpz_class>(integers->add_only_integers()), 2 * big + 3);
+
+    const ExpressionRef rationals = expression(head, std::vector<BaseExpressionRef>{
+        from_primitive(mpq_class(1, 2)), from_primitive(mpq_class(1, 3)),
+        from_primitive(mpq_class(1, 6)), from_primitive(mpq_class(1, 4))});
+    EXPECT_EQ(rationals->slice_type_id(), PackSliceRationalCode);
+    EXPECT_EQ(to_primitive<mpq_class>(rationals->add_only_rationals()), mpq_class(5, 4));
+}
+
+
+static size_t allocations() {
+    size_t n = 0;
+    for (const AllocationStatistics &entry : Heap::statistics()) {
+        n += entry.allocations;
+    }
+    return n;
+}
+
+
+TEST(Expression, borrowed_leaves) {
+    Definitions definitions;
+    const BaseExpressionRef head = from_primitive(std::string("List"));
+
+    std::vector<machine_integer_t> values;
+    std::vector<BaseExpressionRef> atoms;
+    for (size_t i = 0; i < 1000; i++) {
+        values.push_back(machine_integer_t(1000000007 + i)); // no immediates
+        atoms.push_back(from_primitive(values.back()));
+    }
+
+    const ExpressionRef a = expression(head, PackSlice<machine_integer_t>(values));
+    const ExpressionRef b = expression(head, PackSlice<machine_integer_t>(values));
+    const ExpressionRef c = expression(head, RangeSlice(1000000007, 1, 1000));
+    const ExpressionRef d = expression(head, PackSlice<std::string>(std::vector<std::string>{"x", "y", "z", "w"}));
+    const ExpressionRef pattern = Heap::Expression(head, std::vector<BaseExpressionRef>(atoms), OptionalTypeMask());
+    const std::vector<mpz_class> small{1, 2, 3, 4};
+    const PackSlice<mpz_class> exact(small);
+
+    // read-only scans over packed leaves must not allocate a single object.
+    const size_t before = allocations();
+
+    EXPECT_TRUE(a->same(b));
+    EXPECT_TRUE(a->same(c));
+    EXPECT_TRUE(c->same(pattern));
+    EXPECT_FALSE(a->same(d));
+    EXPECT_EQ(a->hash(), b->hash());
+    EXPECT_EQ(d->hash(), d->hash());
+    EXPECT_TRUE(match(pattern, a, definitions));
+    EXPECT_TRUE(match(pattern, c, definitions));
+
+    size_t calls = 0;
+    EXPECT_FALSE(apply(head, exact, 0, exact.size(), [&calls] (const BaseExpressionRef &leaf) {
+        calls++;
+        return BaseExpressionRef();
+    }, false, MakeTypeMask(BigIntegerType)));
+    EXPECT_EQ(calls, 0);
+
+    EXPECT_EQ(allocations(), before);
+}
@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <gtest/gtest.h>
+
+#include "core/types.h"
+#include "core/expression.h"
+#include "core/definitions.h"
+
+
+TEST(Hash, big_integer) {
+    const mpz_class big("123456789012345678901234567890");
+    BigInteger a(big);
+    BigInteger b(big);
+    BigInteger c(big + 1);
+    BigInteger d(-big);
+
+    mpz_realloc2(b.value.get_mpz_t(), 4096); // more limbs reserved, same value
+    EXPECT_TRUE(a.same(b));
+    EXPECT_EQ(a.hash(), b.hash());
+    EXPECT_NE(a.hash(), c.hash());
+    EXPECT_NE(a.hash(), d.hash());
+}
+
+
+TEST(Hash, rational) {
+    Rational a(mpq_class(2, 3));
+    Rational b(mpq_class(1, 3) + mpq_class(1, 3)); // canonical, as arithmetic yields
+    Rational c(mpq_class(3, 2));
+
+    EXPECT_TRUE(a.same(b));
+    EXPECT_EQ(a.hash(), b.hash());
+    EXPECT_FALSE(a.same(c));
+    EXPECT_NE(a.hash(), c.hash());
+}
+
+
+TEST(Hash, machine_real) {
+    EXPECT_TRUE(MachineReal(0.).same(MachineReal(-0.)));
+    EXPECT_EQ(MachineReal(0.).hash(), MachineReal(-0.).hash());
+
+    // values that only differ in their fraction must not collide.
+    EXPECT_NE(MachineReal(1.5).hash(), MachineReal(1.25).hash());
+    EXPECT_NE(MachineReal(0.5).hash(), MachineReal(0.).hash());
+}
+
+
+TEST(Hash, string) {
+    // packed strings and owned strings are the same.
+    const PackSlice<std::string> packed(std::vector<std::string>{"ab", "c"});
+    EXPECT_EQ(packed[0]->hash(), from_primitive(std::string("ab"))->hash());
+    EXPECT_NE(packed[0]->hash(), packed[1]->hash());
+}
+
+
+TEST(Hash, packed) {
+    Definitions definitions;
+    const SymbolRef &List = definitions.List();
+
+    // the same list, packed and unpacked, must have the same hash.
+    for (size_t n : {4, 5, 9, 1000}) {
+        std::vector<machine_integer_t> integers;
+        std::vector<machine_real_t> reals;
+        std::vector<BaseExpressionRef> integer_leaves;
+        std::vector<BaseExpressionRef> real_leaves;
+        for (size_t i = 0; i < n; i++) {
+            integers.push_back(machine_integer_t(i) * 1000003);
+            reals.push_back(i * 0.5);
+            integer_leaves.push_back(from_primitive(integers.back()));
+            real_leaves.push_back(from_primitive(reals.back()));
+        }
+
+        const ExpressionRef packed_integers = expression(List, PackSlice<machine_integer_t>(integers));
+        const ExpressionRef refs_integers = Heap::Expression(List, std::move(integer_leaves), OptionalTypeMask());
+        EXPECT_EQ(packed_integers->hash(), refs_integers->hash());
+        EXPECT_TRUE(packed_integers->same(refs_integers));
+
+        const ExpressionRef packed_reals = expression(List, PackSlice<machine_real_t>(reals));
+        const ExpressionRef refs_reals = Heap::Expression(List, std::move(real_leaves), OptionalTypeMask());
+        EXPECT_EQ(packed_reals->hash(), refs_reals->hash());
+        EXPECT_NE(packed_reals->hash(), packed_integers->hash());
+    }
+}
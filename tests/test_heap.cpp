@@ -0,0 +1,545 @@
+#include <stdlib.h>
+#include <gtest/gtest.h>
+#include <set>
+#include <thread>
+
+#include "core/types.h"
+#include "core/integer.h"
+#include "core/expression.h"
+#include "core/definitions.h"
+
+
+TEST(SlabPool, construct_free) {
+    ObjectPool<MachineInteger> pool;
+
+    MachineInteger *p = pool.construct(5);
+    EXPECT_EQ(p->type(), MachineIntegerType);
+    EXPECT_EQ(p->value, 5);
+    pool.free(p);
+}
+
+
+TEST(SlabPool, reuse_lifo) {
+    ObjectPool<MachineInteger> pool;
+
+    MachineInteger *a = pool.construct(1);
+    MachineInteger *b = pool.construct(2);
+    pool.free(a);
+    pool.free(b);
+
+    // the most recently freed slot is handed out first.
+    EXPECT_EQ(pool.construct(3), b);
+    EXPECT_EQ(pool.construct(4), a);
+}
+
+
+TEST(SlabPool, many_pages) {
+    ObjectPool<MachineInteger> pool;
+    const size_t n = 4 * PoolPageSize / sizeof(MachineInteger);
+
+    auto page = [] (MachineInteger *p) {
+        return reinterpret_cast<uintptr_t>(p) & ~uintptr_t(PoolPageSize - 1);
+    };
+
+    std::vector<MachineInteger*> objects;
+    std::set<MachineInteger*> unique;
+    std::set<uintptr_t> pages;
+    for (size_t i = 0; i < n; i++) {
+        MachineInteger *p = pool.construct(machine_integer_t(i));
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % alignof(MachineInteger), 0);
+        objects.push_back(p);
+        unique.insert(p);
+        pages.insert(page(p));
+    }
+    EXPECT_EQ(unique.size(), n);
+    EXPECT_GE(pages.size(), 4);
+
+    for (size_t i = 0; i < n; i++) {
+        EXPECT_EQ(objects[i]->value, i);
+    }
+
+    // free every other object and make sure the freed slots get reused, not new pages.
+    for (size_t i = 0; i < n; i += 2) {
+        pool.free(objects[i]);
+    }
+    for (size_t i = 0; i < n; i += 2) {
+        MachineInteger *p = pool.construct(machine_integer_t(i));
+        EXPECT_TRUE(pages.find(page(p)) != pages.end());
+    }
+}
+
+
+static uintptr_t page_of(const BaseExpressionRef &p) {
+    return reinterpret_cast<uintptr_t>(p.get()) & ~uintptr_t(PoolPageSize - 1);
+}
+
+
+TEST(Heap, remote_free) {
+    const size_t n = 4 * PoolPageSize / sizeof(MachineInteger);
+    const machine_integer_t offset = Immediates::MaxInteger + 1;
+
+    std::vector<BaseExpressionRef> objects;
+    std::set<uintptr_t> pages;
+    for (size_t i = 0; i < n; i++) {
+        objects.push_back(from_primitive(offset + machine_integer_t(i)));
+        pages.insert(page_of(objects.back()));
+    }
+
+    // release all objects on another thread; their slots go back to this thread's heap.
+    std::thread other([&objects] () {
+        objects.clear();
+    });
+    other.join();
+
+    for (size_t i = 0; i < n; i++) {
+        objects.push_back(from_primitive(offset + machine_integer_t(i)));
+        EXPECT_TRUE(pages.find(page_of(objects.back())) != pages.end());
+    }
+}
+
+
+TEST(Heap, parallel) {
+    const size_t n_threads = 4;
+    std::vector<machine_integer_t> sums(n_threads);
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < n_threads; t++) {
+        threads.emplace_back([t, &sums] () {
+            const BaseExpressionRef head = from_primitive(std::string("f"));
+            machine_integer_t sum = 0;
+            for (size_t k = 0; k < 1000; k++) {
+                std::vector<BaseExpressionRef> leaves;
+                for (size_t i = 0; i < 10; i++) {
+                    leaves.push_back(expression(head, {from_primitive(machine_integer_t(i + t))}));
+                }
+                const ExpressionRef expr = expression(head, std::move(leaves));
+                for (size_t i = 0; i < expr->size(); i++) {
+                    const auto leaf = boost::static_pointer_cast<const Expression>(expr->leaf(i));
+                    sum += boost::static_pointer_cast<const MachineInteger>(leaf->leaf(0))->value;
+                }
+            }
+            sums[t] = sum;
+        });
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (size_t t = 0; t < n_threads; t++) {
+        EXPECT_EQ(sums[t], 1000 * (45 + 10 * t));
+    }
+}
+
+
+TEST(Arena, promote) {
+    const BaseExpressionRef head = from_primitive(std::string("f"));
+
+    BaseExpressionRef temporary;
+    {
+        const ArenaScope arena;
+        temporary = expression(head, {
+            from_primitive(machine_integer_t(1)),
+            expression(head, {from_primitive(machine_integer_t(2))})});
+    }
+    EXPECT_TRUE(Heap::is_arena_allocated(temporary.get()));
+
+    const BaseExpressionRef promoted = Heap::promote(temporary);
+    EXPECT_FALSE(Heap::is_arena_allocated(promoted.get()));
+    EXPECT_TRUE(promoted->same(temporary));
+
+    const auto expr = boost::static_pointer_cast<const Expression>(promoted);
+    EXPECT_FALSE(Heap::is_arena_allocated(expr->leaf(0).get()));
+    EXPECT_FALSE(Heap::is_arena_allocated(expr->leaf(1).get()));
+
+    // objects outside the arena are not copied.
+    EXPECT_EQ(Heap::promote(promoted), promoted);
+}
+
+
+TEST(Arena, promote_deep) {
+    // promoting this recursively would overflow the stack.
+    const BaseExpressionRef head = from_primitive(std::string("f"));
+    const size_t depth = 1000000;
+
+    BaseExpressionRef temporary;
+    {
+        const ArenaScope arena;
+        temporary = from_primitive(std::string("x"));
+        for (size_t i = 0; i < depth; i++) {
+            // nested through leaves and through heads.
+            temporary = i % 2 ? expression(head, {temporary, from_primitive(machine_integer_t(i))}) :
+                expression(temporary, {head});
+        }
+    }
+
+    const BaseExpressionRef promoted = Heap::promote(temporary);
+    temporary.reset();
+
+    const BaseExpression *item = promoted.get();
+    for (size_t i = depth; i > 0; i--) {
+        ASSERT_EQ(item->type(), ExpressionType);
+        ASSERT_FALSE(Heap::is_arena_allocated(item));
+        const Expression * const expr = static_cast<const Expression*>(item);
+        if ((i - 1) % 2) {
+            EXPECT_FALSE(Heap::is_arena_allocated(expr->leaf(1).get()));
+            item = expr->leaf(0).get();
+        } else {
+            item = expr->_head.get();
+        }
+    }
+    EXPECT_EQ(item->fullform(), "x");
+    EXPECT_FALSE(Heap::is_arena_allocated(item));
+}
+
+
+TEST(Arena, reuse) {
+    const ArenaScope arena;
+
+    const BaseExpression *address;
+    {
+        const BaseExpressionRef first = from_primitive(machine_integer_t(1000001));
+        address = first.get();
+    }
+
+    // the chunk held no more live objects and got reset.
+    const BaseExpressionRef second = from_primitive(machine_integer_t(1000002));
+    EXPECT_EQ(second.get(), address);
+}
+
+
+TEST(Heap, packed) {
+    const BaseExpressionRef head = from_primitive(std::string("List"));
+
+    BaseExpressionRef temporary;
+    {
+        const ArenaScope arena;
+        temporary = expression(head, PackSlice<std::string>(
+            std::vector<std::string>{"a", "b", "c", "d", "e"}));
+    }
+    EXPECT_TRUE(Heap::is_arena_allocated(temporary.get()));
+
+    const BaseExpressionRef promoted = Heap::promote(temporary);
+    temporary.reset();
+    EXPECT_FALSE(Heap::is_arena_allocated(promoted.get()));
+
+    const auto expr = boost::static_pointer_cast<const Expression>(promoted);
+    ASSERT_EQ(expr->size(), 5);
+    EXPECT_EQ(expr->leaf(4)->fullform(), "e");
+
+    // slices share the extent of the expression they were taken from.
+    const auto packed = boost::static_pointer_cast<const ExpressionImplementation<PackSlice<std::string>>>(promoted);
+    const auto sliced = expression(head, packed->_leaves.slice(1, 3));
+    EXPECT_EQ(sliced->size(), 2);
+    EXPECT_EQ(sliced->leaf(0)->fullform(), "b");
+}
+
+
+TEST(Heap, refs_block) {
+    const BaseExpressionRef head = from_primitive(std::string("f"));
+
+    for (size_t n : {10, 1000}) {
+        std::vector<BaseExpressionRef> leaves;
+        for (size_t i = 0; i < n; i++) {
+            leaves.push_back(expression(head, {from_primitive(machine_integer_t(i))}));
+        }
+
+        ExpressionRef expr = expression(head, std::move(leaves));
+        const auto refs_expr = boost::static_pointer_cast<const RefsExpression>(expr);
+        // small expressions share one block with their leaves, large ones do not.
+        EXPECT_EQ(refs_expr->_leaves.extent()->block() == refs_expr.get(), n < 256);
+
+        // a slice keeps the leaves alive after the expression is gone.
+        const ExpressionRef sliced = expr->slice(1, n - 1);
+        expr.reset();
+        ASSERT_EQ(sliced->size(), n - 2);
+        EXPECT_EQ(sliced->leaf(n - 3)->fullform(), "f[" + std::to_string(n - 2) + "]");
+    }
+}
+
+
+// taken during static initialization, maybe before heap.cpp got initialized.
+static const BaseExpressionRef s_static_immediate = from_primitive(machine_integer_t(7));
+
+TEST(Immediates, integers) {
+    const BaseExpressionRef a = from_primitive(machine_integer_t(7));
+    const BaseExpressionRef b = from_primitive(machine_integer_t(7));
+    EXPECT_EQ(a.get(), b.get());
+    EXPECT_EQ(s_static_immediate.get(), a.get());
+    EXPECT_TRUE(s_static_immediate->is_immortal());
+    EXPECT_TRUE(Immediates::contains(a.get()));
+    EXPECT_EQ(boost::static_pointer_cast<const MachineInteger>(a)->value, 7);
+
+    for (machine_integer_t value : {Immediates::MinInteger, Immediates::MaxInteger}) {
+        const BaseExpressionRef immediate = from_primitive(value);
+        EXPECT_TRUE(Immediates::contains(immediate.get()));
+        EXPECT_EQ(boost::static_pointer_cast<const MachineInteger>(immediate)->value, value);
+    }
+
+    for (machine_integer_t value : {Immediates::MinInteger - 1, Immediates::MaxInteger + 1}) {
+        const BaseExpressionRef boxed = from_primitive(value);
+        EXPECT_FALSE(Immediates::contains(boxed.get()));
+        EXPECT_TRUE(boxed->same(MachineInteger(value)));
+    }
+
+    // immediates are never arena allocated.
+    const ArenaScope arena;
+    EXPECT_EQ(from_primitive(machine_integer_t(0)).get(), Immediates::integer(0));
+}
+
+
+TEST(Heap, release_deep) {
+    // releasing this recursively would overflow the stack.
+    const BaseExpressionRef head = from_primitive(std::string("f"));
+    BaseExpressionRef expr = from_primitive(std::string("x"));
+    for (size_t i = 0; i < 1000000; i++) {
+        expr = expression(head, {expr});
+    }
+    expr.reset();
+    EXPECT_EQ(Heap::pending_releases(), 0);
+}
+
+
+TEST(Heap, release_deferred) {
+    const BaseExpressionRef head = from_primitive(std::string("f"));
+    {
+        const DeferredRelease deferred;
+
+        BaseExpressionRef expr = expression(head, {from_primitive(std::string("x"))});
+        expr.reset();
+        EXPECT_EQ(Heap::pending_releases(), 1);
+
+        for (size_t i = 0; i < Heap::ReleaseBatchSize; i++) {
+            expression(head, {head});
+        }
+        // a full batch was freed on the way.
+        EXPECT_LT(Heap::pending_releases(), Heap::ReleaseBatchSize);
+    }
+    EXPECT_EQ(Heap::pending_releases(), 0);
+}
+
+
+static AllocationStatistics statistics_of(const char *name) {
+    for (const AllocationStatistics &entry : Heap::statistics()) {
+        if (std::string(entry.name) == name) {
+            return entry;
+        }
+    }
+    throw std::runtime_error("no such statistics");
+}
+
+
+TEST(Heap, statistics) {
+    const AllocationStatistics before = statistics_of("String");
+    const size_t in_use_before = Heap::memory_in_use();
+
+    std::vector<BaseExpressionRef> strings;
+    for (size_t i = 0; i < 1000; i++) {
+        strings.push_back(from_primitive(std::string("s")));
+    }
+
+    const AllocationStatistics after = statistics_of("String");
+    EXPECT_EQ(after.live_bytes - before.live_bytes, 1000 * after.object_size);
+    EXPECT_EQ(after.allocations - before.allocations, 1000);
+    EXPECT_GE(after.peak_bytes, after.live_bytes);
+    EXPECT_GE(Heap::memory_in_use() - in_use_before, 1000 * sizeof(String));
+    EXPECT_GE(Heap::max_memory_used(), Heap::memory_in_use());
+
+    // slots freed on other threads count as free before the owner drains them, so that
+    // the numbers do not depend on what earlier tests left behind.
+    std::thread other([&strings] () {
+        strings.resize(500);
+    });
+    other.join();
+    EXPECT_EQ(statistics_of("String").live_bytes - before.live_bytes, 500 * after.object_size);
+
+    strings.clear();
+    EXPECT_EQ(statistics_of("String").live_bytes, before.live_bytes);
+}
+
+
+TEST(Heap, byte_count) {
+    const BaseExpressionRef head = from_primitive(std::string("f"));
+    const BaseExpressionRef x = from_primitive(machine_integer_t(1));
+
+    EXPECT_EQ(Heap::byte_count(x), sizeof(MachineInteger));
+
+    const size_t string_bytes = sizeof(String) + 1;
+    EXPECT_EQ(Heap::byte_count(expression(head, {x, x})),
+        sizeof(ExpressionImplementation<InPlaceRefsSlice<2>>) + string_bytes + 2 * sizeof(MachineInteger));
+
+    const BaseExpressionRef packed = expression(head, PackSlice<machine_integer_t>(
+        std::vector<machine_integer_t>{1, 2, 3, 4, 5}));
+    EXPECT_EQ(Heap::byte_count(packed),
+        sizeof(ExpressionImplementation<PackSlice<machine_integer_t>>) + string_bytes + 5 * sizeof(machine_integer_t));
+}
+
+
+TEST(Heap, memory_budget) {
+    const BaseExpressionRef head = from_primitive(std::string("f"));
+    const size_t before = MemoryBudget::used();
+    {
+        const MemoryBudget budget(64 * 1024);
+
+        std::vector<BaseExpressionRef> kept;
+        EXPECT_THROW({
+            while (true) {
+                kept.push_back(from_primitive(machine_integer_t(1) << 40));
+            }
+        }, MemoryLimitExceeded);
+        EXPECT_LE(MemoryBudget::used(), 64 * 1024);
+
+        // freeing gives the budget back.
+        kept.clear();
+        EXPECT_EQ(MemoryBudget::used(), 0);
+        expression(head, {head});
+    }
+    EXPECT_EQ(MemoryBudget::used(), before);
+}
+
+
+TEST(Heap, interning) {
+    const BaseExpressionRef head = from_primitive(std::string("f"));
+    const size_t before = Heap::interned_count();
+
+    EXPECT_NE(from_primitive(machine_integer_t(1000000007)).get(), from_primitive(machine_integer_t(1000000007)).get());
+
+    {
+        Interning interning;
+
+        const BaseExpressionRef x = from_primitive(std::string("x"));
+        const BaseExpressionRef n = from_primitive(machine_integer_t(1000000007));
+        EXPECT_TRUE(x->is_interned());
+        EXPECT_EQ(from_primitive(std::string("x")).get(), x.get());
+        EXPECT_EQ(from_primitive(machine_integer_t(1000000007)).get(), n.get());
+        EXPECT_EQ(from_primitive(mpz_class("123456789012345678901234567890")).get(),
+            from_primitive(mpz_class("123456789012345678901234567890")).get());
+        EXPECT_EQ(Heap::MachineReal(1.5).get(), Heap::MachineReal(1.5).get());
+        EXPECT_NE(Heap::MachineReal(0.).get(), Heap::MachineReal(-0.).get());
+
+        const ExpressionRef a = expression(head, std::vector<BaseExpressionRef>{x, n});
+        const ExpressionRef b = expression(head, std::vector<BaseExpressionRef>{from_primitive(std::string("x")), n});
+        const ExpressionRef c = tiny_expression<2>(head, [&x, &n] (auto &storage) {
+            storage << x << n;
+        });
+        const ExpressionRef d = expression(head, std::vector<BaseExpressionRef>{n, x});
+        EXPECT_EQ(a.get(), b.get());
+        EXPECT_EQ(a.get(), c.get());
+        EXPECT_NE(a.get(), d.get());
+        EXPECT_TRUE(a->same(c));
+        EXPECT_FALSE(a->same(d));
+        EXPECT_EQ(expression(head, std::vector<BaseExpressionRef>{a, a}).get(),
+            expression(head, std::vector<BaseExpressionRef>{b, c}).get());
+
+        // same() still compares values of objects that are not interned.
+        const StringExtent::Ref extent = StringExtent::construct(std::vector<std::string>{"x"});
+        const BaseExpressionRef plain = Heap::String(extent, (*extent)[0]);
+        EXPECT_FALSE(plain->is_interned());
+        EXPECT_TRUE(x->same(plain));
+
+        {
+            ArenaScope arena;
+            EXPECT_FALSE(Heap::MachineReal(1.5)->is_interned());
+        }
+
+        // erasing entries keeps the remaining ones reachable.
+        std::vector<BaseExpressionRef> many;
+        for (size_t i = 0; i < 10000; i++) {
+            many.push_back(from_primitive(machine_integer_t(2000000000 + i)));
+        }
+        for (size_t i = 1; i < many.size(); i += 2) {
+            many[i].reset();
+        }
+        for (size_t i = 0; i < many.size(); i += 2) {
+            EXPECT_EQ(from_primitive(machine_integer_t(2000000000 + i)).get(), many[i].get());
+        }
+
+        EXPECT_GT(Heap::interned_count(), before);
+    }
+
+    // the table holds weak references only.
+    EXPECT_EQ(Heap::interned_count(), before);
+}
+
+
+TEST(Heap, interning_deferred) {
+    // objects waiting in the release list must not be handed out again.
+    Interning interning;
+    DeferredRelease deferred;
+
+    const BaseExpressionRef head = from_primitive(std::string("f"));
+    const size_t before = Heap::interned_count();
+    const BaseExpression *released;
+    {
+        const BaseExpressionRef x = from_primitive(machine_integer_t(1000000007));
+        released = expression(head, std::vector<BaseExpressionRef>{x}).get();
+    }
+    EXPECT_GT(Heap::pending_releases(), 0);
+    EXPECT_EQ(Heap::interned_count(), before + 1); // x, until the queued expression is freed
+
+    const BaseExpressionRef x = from_primitive(machine_integer_t(1000000007));
+    const ExpressionRef again = expression(head, std::vector<BaseExpressionRef>{x});
+    EXPECT_NE(again.get(), released); // still queued, i.e. not yet freed
+    EXPECT_EQ(again->fullform(), "f[1000000007]");
+    EXPECT_TRUE(again->is_interned());
+}
+
+TEST(Heap, interning_remote) {
+    // interned objects released on another thread go back to the interning thread.
+    Interning interning;
+
+    const size_t before = Heap::interned_count();
+    BaseExpressionRef x = from_primitive(machine_integer_t(1000000009));
+    EXPECT_TRUE(x->is_interned());
+    EXPECT_EQ(Heap::interned_count(), before + 1);
+
+    std::thread other([&x] () {
+        x.reset();
+    });
+    other.join();
+
+    EXPECT_EQ(Heap::interned_count(), before);
+    const BaseExpressionRef y = from_primitive(machine_integer_t(1000000009));
+    EXPECT_TRUE(y->is_interned());
+    EXPECT_EQ(static_cast<const MachineInteger*>(y.get())->value, 1000000009);
+}
+
+TEST(Heap, immortal) {
+    EXPECT_TRUE(from_primitive(machine_integer_t(1))->is_immortal());
+    EXPECT_FALSE(from_primitive(machine_integer_t(1000000007))->is_immortal());
+
+    const BaseExpressionRef head = from_primitive(std::string("f"));
+    BaseExpressionRef kept;
+    BaseExpressionRef reused;
+    {
+        ImmortalScope immortal;
+
+        kept = expression(head, std::vector<BaseExpressionRef>{Heap::MachineInteger(1000000007)});
+        Heap::MachineReal(1.5); // released right away
+        reused = Heap::MachineReal(2.5); // likely takes the slot of 1.5
+
+        EXPECT_FALSE(kept->is_immortal()); // only once the scope ends
+    }
+
+    // what survived the scope never changes its reference count again and never gets freed.
+    EXPECT_TRUE(kept->is_immortal());
+    EXPECT_TRUE(static_cast<const Expression*>(kept.get())->has_metadata());
+    EXPECT_TRUE(static_cast<const Expression*>(kept.get())->leaf(0)->is_immortal());
+    EXPECT_TRUE(reused->is_immortal());
+    EXPECT_FALSE(head->is_immortal());
+
+    const BaseExpression * const raw = kept.get();
+    kept.reset();
+    EXPECT_EQ(raw->fullform(), "f[1000000007]");
+    {
+        const BaseExpressionRef copy(raw);
+        EXPECT_TRUE(copy->is_immortal());
+    }
+
+    // objects released within the scope were freed as usual.
+    EXPECT_FALSE(Heap::MachineReal(1.5)->is_immortal());
+
+    Definitions definitions;
+    definitions.make_immortal();
+    EXPECT_TRUE(definitions.List()->is_immortal());
+}
@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include "core/types.h"
+#include "core/real.h"
+#include "core/expression.h"
+#include "core/definitions.h"
+#include "core/evaluation.h"
+#include "core/mapped.h"
+
+
+namespace {
+    std::string temporary_file(const void *data, size_t bytes) {
+        char path[] = "/tmp/cmathics_mapped_XXXXXX";
+        const int fd = mkstemp(path);
+        EXPECT_GE(fd, 0);
+        EXPECT_EQ(write(fd, data, bytes), bytes);
+        close(fd);
+        return path;
+    }
+}
+
+
+TEST(Mapped, extent) {
+    char path[] = "/tmp/cmathics_mapped_XXXXXX";
+    const int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    std::vector<machine_real_t> values;
+    for (int i = 0; i < 1000; i++) {
+        values.push_back(i * 0.5);
+    }
+    ASSERT_EQ(write(fd, values.data(), values.size() * sizeof(machine_real_t)),
+        values.size() * sizeof(machine_real_t));
+    close(fd);
+
+    const size_t extent_bytes_before = Heap::memory_in_use();
+    {
+        const PackExtent<machine_real_t>::Ref extent = PackExtent<machine_real_t>::map(path);
+        EXPECT_TRUE(extent->is_mapped());
+        ASSERT_EQ(extent->size(), 1000);
+
+        const PackSlice<machine_real_t> slice(extent, extent->address(), extent->size());
+        const PackSlice<machine_real_t> tail = slice.slice(990);
+        EXPECT_EQ(tail.data(), extent->address() + 990); // no copy
+        EXPECT_EQ(tail.size(), 10);
+
+        const BaseExpressionRef head = from_primitive(std::string("Plus"));
+        const ExpressionRef sum = expression(head, slice);
+        EXPECT_EQ(static_cast<const MachineReal*>(sum->add_only_machine_reals().get())->value, 249750.);
+
+        // the data itself is not heap memory.
+        EXPECT_LT(Heap::memory_in_use() - extent_bytes_before, 1000 * sizeof(machine_real_t));
+    }
+
+    unlink(path);
+    EXPECT_THROW(PackExtent<machine_real_t>::map(path), std::runtime_error);
+}
+
+
+TEST(Mapped, binary_read_list) {
+    Definitions definitions;
+    const Evaluation evaluation(definitions, false, false);
+
+    const std::vector<machine_integer_t> values{1, 2, 3, 4, 5};
+    const std::string path = temporary_file(values.data(), values.size() * sizeof(machine_integer_t));
+
+    const BaseExpressionRef list = BinaryReadList(
+        from_primitive(path), from_primitive(std::string("Integer64")), evaluation);
+    ASSERT_TRUE(list);
+    EXPECT_EQ(list->fullform(), "System`List[1, 2, 3, 4, 5]");
+
+    // 40 bytes are no whole number of complex values.
+    EXPECT_EQ(BinaryReadList(from_primitive(path), from_primitive(std::string("Complex128")), evaluation)->fullform(),
+        "System`$Failed");
+    EXPECT_THROW(PackExtent<machine_complex_t>::map(path.c_str()), std::runtime_error);
+
+    unlink(path.c_str());
+    EXPECT_EQ(BinaryReadList(from_primitive(path), from_primitive(std::string("Real64")), evaluation)->fullform(),
+        "System`$Failed");
+}
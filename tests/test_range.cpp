@@ -0,0 +1,75 @@
+#include <stdlib.h>
+#include <gtest/gtest.h>
+
+#include "core/types.h"
+#include "core/expression.h"
+#include "core/definitions.h"
+#include "core/range.h"
+
+
+namespace {
+    machine_integer_t integer(const BaseExpressionRef &expr) {
+        EXPECT_EQ(expr->type(), MachineIntegerType);
+        return static_cast<const MachineInteger*>(expr.get())->value;
+    }
+}
+
+
+TEST(Range, leaves) {
+    Definitions definitions;
+    const ExpressionRef r = expression(definitions.List(), RangeSlice(1, 1, 1000000000));
+    EXPECT_EQ(r->slice_type_id(), RangeSliceCode);
+    EXPECT_EQ(r->size(), 1000000000);
+    EXPECT_EQ(integer(r->leaf(0)), 1);
+    EXPECT_EQ(integer(r->leaf(999999999)), 1000000000);
+    EXPECT_EQ(Heap::byte_count(r), sizeof(ExpressionImplementation<RangeSlice>));
+
+    const ExpressionRef window = r->slice(-3);
+    EXPECT_EQ(window->slice_type_id(), RangeSliceCode);
+    EXPECT_EQ(window->fullform(), "System`List[999999998, 999999999, 1000000000]");
+
+    const ExpressionRef down = expression(definitions.List(), RangeSlice(10, -3, 4));
+    EXPECT_EQ(down->fullform(), "System`List[10, 7, 4, 1]");
+    EXPECT_EQ(down->slice(1, 3)->fullform(), "System`List[7, 4]");
+    EXPECT_TRUE(down->same(expression(definitions.List(), PackSlice<machine_integer_t>({10, 7, 4, 1}))));
+
+    // i * step does not fit into a machine integer, the value does.
+    const machine_integer_t max = std::numeric_limits<machine_integer_t>::max();
+    const RangeSlice wide(-max, 2, size_t(max));
+    EXPECT_EQ(wide.value(size_t(max) - 1), max - 2);
+}
+
+
+TEST(Range, total) {
+    Definitions definitions;
+    // closed form, without touching the leaves.
+    const ExpressionRef r = expression(definitions.List(), RangeSlice(1, 1, 1000000000));
+    EXPECT_EQ(r->add_only_integers()->fullform(), "500000000500000000");
+
+    const ExpressionRef large = expression(definitions.List(),
+        RangeSlice(std::numeric_limits<machine_integer_t>::max() - 1, -1, 3));
+    const BaseExpressionRef total = large->add_only_integers();
+    ASSERT_EQ(total->type(), BigIntegerType);
+    EXPECT_EQ(static_cast<const BigInteger*>(total.get())->value, mpz_class("27670116110564327415"));
+}
+
+
+TEST(Range, materialize) {
+    Definitions definitions;
+    const RangeSlice down(10, -3, 4);
+    const PackSlice<machine_integer_t> values = down.materialize();
+    ASSERT_EQ(values.size(), 4);
+    EXPECT_EQ(values.data()[0], 10);
+    EXPECT_EQ(values.data()[3], 1);
+
+    // ranges that are packed into a tensor are materialized once.
+    const SymbolRef &List = definitions.List();
+    const ExpressionRef matrix = expression(List, std::vector<BaseExpressionRef>{
+        expression(List, RangeSlice(1, 1, 3)),
+        expression(List, PackSlice<machine_integer_t>({4, 5, 6})),
+        expression(List, down.slice(1)),
+        expression(List, RangeSlice(-2, 2, 3))});
+    EXPECT_EQ(matrix->slice_type_id(), TensorSliceMachineIntegerCode);
+    EXPECT_EQ(matrix->fullform(), "System`List[System`List[1, 2, 3], System`List[4, 5, 6], "
+        "System`List[7, 4, 1], System`List[-2, 0, 2]]");
+}
@@ -8,31 +8,24 @@
 
 
 TEST(Rational, Rational_init) {
-    mpq_t value;
-    mpq_init(value);
-    mpq_set_str(value, "1/1", 10);
+    const mpq_class value("1/1", 10);
 
-    Rational q = Rational(value);
+    Rational q(value);
     EXPECT_EQ(q.type(), RationalType);
 }
 
 
 TEST(Rational, Rational_set) {
-    mpq_t value;
-    mpq_init(value);
-    mpq_set_str(value, "5/7", 10);
+    const mpq_class value("5/7", 10);
 
     Rational q(value);
-    EXPECT_EQ(mpq_cmp(q.value, value), 0);
+    EXPECT_EQ(q.value, value);
 }
 
 TEST(Rational, Rational_numer) {
-    mpq_t value;
-    mpq_init(value);
-    mpq_set_si(value, 5, 7);
-    Rational q(value);
+    Rational q(mpq_class(5, 7));
 
     BaseExpressionRef integer = q.numer();
     EXPECT_EQ(integer->type(), MachineIntegerType);
-    EXPECT_EQ(std::static_pointer_cast<const MachineInteger>(integer)->value, 5);
+    EXPECT_EQ(boost::static_pointer_cast<const MachineInteger>(integer)->value, 5);
 }
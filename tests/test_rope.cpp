@@ -0,0 +1,107 @@
+#include <stdlib.h>
+#include <gtest/gtest.h>
+
+#include "core/types.h"
+#include "core/expression.h"
+#include "core/rope.h"
+
+
+namespace {
+    ExpressionRef integers(const BaseExpressionRef &head, machine_integer_t begin, machine_integer_t end) {
+        std::vector<BaseExpressionRef> leaves;
+        for (machine_integer_t i = begin; i < end; i++) {
+            leaves.push_back(from_primitive(i));
+        }
+        return expression(head, std::move(leaves));
+    }
+
+    void expect_integers(const ExpressionRef &expr, machine_integer_t begin, machine_integer_t end) {
+        ASSERT_EQ(expr->size(), end - begin);
+        for (machine_integer_t i = begin; i < end; i++) {
+            ASSERT_EQ(expr->leaf(i - begin)->type(), MachineIntegerType);
+            EXPECT_EQ(static_cast<const MachineInteger*>(expr->leaf(i - begin).get())->value, i);
+        }
+    }
+}
+
+
+TEST(Rope, append) {
+    const BaseExpressionRef head = from_primitive(std::string("List"));
+
+    ExpressionRef list = integers(head, 0, 0);
+    for (machine_integer_t i = 0; i < 1000; i++) {
+        const ExpressionRef previous = list;
+        list = concatenate(list.get(), expression(head, {from_primitive(i)}).get());
+        EXPECT_EQ(previous->size(), i); // older versions stay intact
+    }
+
+    EXPECT_EQ(list->slice_type_id(), RopeSliceCode);
+    const RopeSlice &slice = static_cast<const ExpressionImplementation<RopeSlice>*>(list.get())->_leaves;
+    EXPECT_LE(slice.root()->height(), 10); // small chunks got merged, and the tree is balanced
+    EXPECT_EQ(list->type_mask(), MakeTypeMask(MachineIntegerType));
+
+    expect_integers(list, 0, 1000);
+}
+
+
+TEST(Rope, join) {
+    const BaseExpressionRef head = from_primitive(std::string("List"));
+
+    const ExpressionRef a = integers(head, 0, 500);
+    const ExpressionRef b = integers(head, 500, 600);
+    const ExpressionRef ab = concatenate(a.get(), b.get());
+    EXPECT_EQ(ab->slice_type_id(), RopeSliceCode);
+    expect_integers(ab, 0, 600);
+
+    // joining ropes shares their nodes.
+    const ExpressionRef abab = concatenate(ab.get(), ab.get());
+    const RopeSlice &slice = static_cast<const ExpressionImplementation<RopeSlice>*>(abab.get())->_leaves;
+    EXPECT_EQ(slice.root()->count(), 7);
+    EXPECT_EQ(abab->size(), 1200);
+    EXPECT_TRUE(abab->slice(600)->same(ab));
+    EXPECT_TRUE(abab->slice(0, 600)->same(ab));
+
+    const ExpressionRef sliced = abab->slice(550, 650);
+    expect_integers(sliced->slice(0, 50), 550, 600);
+    expect_integers(sliced->slice(50), 0, 50);
+}
+
+
+TEST(Rope, flatten) {
+    const BaseExpressionRef head = from_primitive(std::string("List"));
+
+    const ExpressionRef a = integers(head, 0, 100);
+    const ExpressionRef rope = concatenate(a.get(), integers(head, 100, 200).get());
+    const RopeSlice &slice = static_cast<const ExpressionImplementation<RopeSlice>*>(rope.get())->_leaves;
+
+    EXPECT_FALSE(slice.flat());
+    for (size_t i = 0; i < rope->size(); i++) {
+        rope->leaf(i);
+    }
+    EXPECT_TRUE(slice.flat()); // random access dominated
+
+    BaseExpressionRef unpacked;
+    const BaseExpressionRef *leaves;
+    ASSERT_EQ(rope->unpack(unpacked, leaves), 200);
+    EXPECT_EQ(static_cast<const MachineInteger*>(leaves[150].get())->value, 150);
+}
+
+
+TEST(Rope, mixed) {
+    const BaseExpressionRef head = from_primitive(std::string("Plus"));
+
+    const ExpressionRef a = integers(head, 0, 100);
+    std::vector<BaseExpressionRef> reals;
+    for (int i = 0; i < 100; i++) {
+        reals.push_back(from_primitive(machine_real_t(0.5)));
+    }
+    const ExpressionRef b = expression(head, std::move(reals));
+
+    const ExpressionRef sum = concatenate(a.get(), b.get());
+    EXPECT_EQ(sum->type_mask(), MakeTypeMask(MachineIntegerType) | MakeTypeMask(MachineRealType));
+    EXPECT_EQ(sum->slice(0, 100)->type_mask(), MakeTypeMask(MachineIntegerType));
+
+    const BaseExpressionRef result = sum->add_machine_inexact();
+    ASSERT_EQ(result->type(), MachineRealType);
+    EXPECT_EQ(static_cast<const MachineReal*>(result.get())->value, 4950. + 50.);
+}
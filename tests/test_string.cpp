@@ -4,6 +4,7 @@
 
 #include "core/types.h"
 #include "core/string.h"
+#include "core/expression.h"
 
 
 /*TEST(String, String_new) {
@@ -22,5 +23,36 @@ TEST(String, String_init) {
 
 TEST(String, String_set) {
     String p("abcde");
-    EXPECT_STREQ(p.value.c_str(), "abcde");
+    EXPECT_STREQ(p.get_string_value(), "abcde");
+}
+
+
+TEST(String, packed) {
+    const BaseExpressionRef head = from_primitive(std::string("List"));
+
+    std::vector<BaseExpressionRef> leaves;
+    for (const char *word : {"alpha", "", "gamma", "a somewhat longer string than fits inline"}) {
+        leaves.push_back(from_primitive(std::string(word)));
+    }
+    const ExpressionRef list = expression(head, std::move(leaves));
+    ASSERT_EQ(list->slice_type_id(), PackSliceStringCode);
+
+    const PackSlice<std::string> &slice =
+        static_cast<const ExpressionImplementation<PackSlice<std::string>>*>(list.get())->_leaves;
+    EXPECT_EQ(slice.view(2), "gamma");
+    EXPECT_EQ(slice.byte_count(), 5 + 0 + 5 + 41 + 4 + 4 * sizeof(size_t));
+
+    // leaves point into the extent instead of copying the bytes.
+    const BaseExpressionRef leaf = list->leaf(3);
+    ASSERT_EQ(leaf->type(), StringType);
+    EXPECT_EQ(static_cast<const String*>(leaf.get())->extent(), slice.extent());
+    EXPECT_EQ(leaf->get_string_value(), slice.view(3).data());
+    EXPECT_EQ(leaf->fullform(), "a somewhat longer string than fits inline");
+    EXPECT_STREQ(list->leaf(1)->get_string_value(), "");
+
+    // slices share the extent.
+    const ExpressionRef tail = list->slice(2);
+    EXPECT_EQ(tail->size(), 2);
+    EXPECT_TRUE(tail->leaf(0)->same(from_primitive(std::string("gamma"))));
+    EXPECT_EQ(static_cast<const String*>(tail->leaf(0).get())->extent(), slice.extent());
 }
@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <gtest/gtest.h>
+
+#include "core/types.h"
+#include "core/expression.h"
+#include "core/definitions.h"
+#include "core/evaluation.h"
+#include "core/tensor.h"
+
+
+namespace {
+    // a rows x columns matrix with elements 10 * i + j.
+    ExpressionRef matrix(Definitions &definitions, size_t rows, size_t columns) {
+        const SymbolRef &List = definitions.List();
+        std::vector<BaseExpressionRef> leaves;
+        for (size_t i = 0; i < rows; i++) {
+            std::vector<BaseExpressionRef> row;
+            for (size_t j = 0; j < columns; j++) {
+                row.push_back(from_primitive(machine_real_t(10 * i + j)));
+            }
+            leaves.push_back(expression(List, std::move(row)));
+        }
+        return expression(List, std::move(leaves));
+    }
+
+    const TensorSlice<machine_real_t> &tensor(const BaseExpressionRef &expr) {
+        EXPECT_EQ(static_cast<const Expression*>(expr.get())->slice_type_id(), TensorSliceMachineRealCode);
+        return static_cast<const ExpressionImplementation<TensorSlice<machine_real_t>>*>(expr.get())->_leaves;
+    }
+
+    void expect_reals(const BaseExpressionRef &expr, const std::vector<machine_real_t> &values) {
+        ASSERT_EQ(expr->type(), ExpressionType);
+        const Expression * const list = static_cast<const Expression*>(expr.get());
+        ASSERT_EQ(list->size(), values.size());
+        for (size_t i = 0; i < values.size(); i++) {
+            ASSERT_EQ(list->leaf(i)->type(), MachineRealType);
+            EXPECT_EQ(static_cast<const MachineReal*>(list->leaf(i).get())->value, values[i]);
+        }
+    }
+
+    BaseExpressionRef leaf(const BaseExpressionRef &expr, size_t i) {
+        return static_cast<const Expression*>(expr.get())->leaf(i);
+    }
+
+    BaseExpressionRef sequence(Definitions &definitions, const std::initializer_list<BaseExpressionRef> &items) {
+        return expression(definitions.Sequence(), items);
+    }
+}
+
+
+TEST(Tensor, pack) {
+    Definitions definitions;
+    const ExpressionRef m = matrix(definitions, 5, 4);
+    const TensorSlice<machine_real_t> &t = tensor(m);
+    EXPECT_EQ(t.rank(), 2);
+    EXPECT_EQ(t.element_count(), 20);
+    EXPECT_TRUE(t.is_contiguous());
+
+    // rows are views onto the tensor's extent.
+    const ExpressionRef row = boost::static_pointer_cast<const Expression>(m->leaf(2));
+    ASSERT_EQ(row->slice_type_id(), PackSliceMachineRealCode);
+    EXPECT_EQ(static_cast<const ExpressionImplementation<PackSlice<machine_real_t>>*>(row.get())->_leaves.data(),
+        t.data() + 8);
+    expect_reals(row, {20, 21, 22, 23});
+
+    // matrices of matrices become rank 3 tensors.
+    const ExpressionRef cube = expression(definitions.List(), std::vector<BaseExpressionRef>{m, m, m, m});
+    EXPECT_EQ(tensor(cube).rank(), 3);
+    expect_reals(leaf(cube->leaf(3), 4), {40, 41, 42, 43});
+
+    // ragged rows stay ordinary lists.
+    const ExpressionRef ragged = expression(definitions.List(),
+        std::vector<BaseExpressionRef>{m->leaf(0), m->leaf(1), m->leaf(2), matrix(definitions, 1, 5)->leaf(0)});
+    EXPECT_EQ(ragged->slice_type_id(), RefsSliceCode);
+}
+
+
+TEST(Tensor, views) {
+    Definitions definitions;
+    Evaluation evaluation(definitions, false, false);
+    const BaseExpressionRef all = definitions.lookup("System`All");
+
+    const ExpressionRef m = matrix(definitions, 5, 4);
+    const TensorSlice<machine_real_t> &t = tensor(m);
+
+    EXPECT_EQ(Dimensions(m, evaluation)->fullform(), "System`List[5, 4]");
+    EXPECT_TRUE(evaluation.evaluate(m)->same(m));
+    EXPECT_EQ(Heap::byte_count(m), sizeof(ExpressionImplementation<TensorSlice<machine_real_t>>) + 20 * sizeof(machine_real_t));
+
+    // a column is a strided view.
+    const BaseExpressionRef column = Part(m, sequence(definitions, {all, from_primitive(machine_integer_t(-1))}), evaluation);
+    EXPECT_EQ(tensor(column).data(), t.data() + 3);
+    expect_reals(column, {3, 13, 23, 33, 43});
+
+    const BaseExpressionRef element = Part(m, sequence(definitions, {from_primitive(machine_integer_t(2)), from_primitive(machine_integer_t(3))}), evaluation);
+    ASSERT_EQ(element->type(), MachineRealType);
+    EXPECT_EQ(static_cast<const MachineReal*>(element.get())->value, 12);
+    EXPECT_FALSE(Part(m, sequence(definitions, {from_primitive(machine_integer_t(6))}), evaluation));
+
+    const BaseExpressionRef transposed = Transpose(m, evaluation);
+    EXPECT_EQ(tensor(transposed).extent(), t.extent());
+    EXPECT_EQ(Dimensions(transposed, evaluation)->fullform(), "System`List[4, 5]");
+    expect_reals(leaf(transposed, 1), {1, 11, 21, 31, 41});
+
+    // flattening a contiguous tensor is a view, flattening a transposed one copies.
+    const BaseExpressionRef flat = Flatten(m, BaseExpressionRef(), evaluation);
+    ASSERT_EQ(static_cast<const Expression*>(flat.get())->slice_type_id(), PackSliceMachineRealCode);
+    EXPECT_EQ(static_cast<const ExpressionImplementation<PackSlice<machine_real_t>>*>(flat.get())->_leaves.data(), t.data());
+    EXPECT_EQ(static_cast<const Expression*>(flat.get())->size(), 20);
+
+    const BaseExpressionRef flat_transposed = Flatten(transposed, BaseExpressionRef(), evaluation);
+    expect_reals(static_cast<const Expression*>(flat_transposed.get())->slice(0, 6), {0, 10, 20, 30, 40, 1});
+}
+
+
+TEST(Tensor, generic) {
+    Definitions definitions;
+    Evaluation evaluation(definitions, false, false);
+    const SymbolRef &List = definitions.List();
+
+    const BaseExpressionRef a = from_primitive(std::string("a"));
+    const BaseExpressionRef b = from_primitive(std::string("b"));
+    const ExpressionRef m = expression(List, {expression(List, {a, b}), expression(List, {a, a})});
+
+    EXPECT_EQ(Dimensions(m, evaluation)->fullform(), "System`List[2, 2]");
+    EXPECT_EQ(Transpose(m, evaluation)->fullform(), "System`List[System`List[a, a], System`List[b, a]]");
+    EXPECT_EQ(Flatten(m, from_primitive(machine_integer_t(1)), evaluation)->fullform(),
+        "System`List[a, b, a, a]");
+    EXPECT_EQ(Part(m, sequence(definitions, {from_primitive(machine_integer_t(1)), from_primitive(machine_integer_t(2))}), evaluation)->fullform(), "b");
+}
@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <gtest/gtest.h>
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+#include "core/types.h"
+#include "core/vectorized.h"
+
+
+TEST(Vectorized, sum_machine_integers) {
+    // sizes that leave tails for the vectorized loops.
+    for (size_t n : {0, 1, 3, 4, 5, 17, 1000, 1027}) {
+        std::vector<machine_integer_t> values(n);
+        __int128 expected = 0;
+        for (size_t i = 0; i < n; i++) {
+            values[i] = (i % 3 == 0) ? -machine_integer_t(i * 7919) : machine_integer_t(i * 104729);
+            expected += values[i];
+        }
+        EXPECT_TRUE(sum_machine_integers(values.data(), n) == expected) << "n = " << n;
+    }
+}
+
+
+TEST(Vectorized, sum_machine_integers_overflow) {
+    const machine_integer_t max = std::numeric_limits<machine_integer_t>::max();
+    const machine_integer_t min = std::numeric_limits<machine_integer_t>::min();
+
+    const std::vector<machine_integer_t> large(9, max);
+    EXPECT_TRUE(sum_machine_integers(large.data(), large.size()) == __int128(max) * 9);
+
+    const std::vector<machine_integer_t> small(9, min);
+    EXPECT_TRUE(sum_machine_integers(small.data(), small.size()) == __int128(min) * 9);
+
+    const std::vector<machine_integer_t> mixed{max, min, max, min, -1, 1, max, max};
+    EXPECT_TRUE(sum_machine_integers(mixed.data(), mixed.size()) == __int128(max) * 2 - 2);
+}
+
+
+TEST(Vectorized, sum_machine_reals) {
+    for (size_t n : {0, 1, 3, 15, 16, 17, 1024, 1025, 100003}) {
+        std::vector<machine_real_t> values(n);
+        for (size_t i = 0; i < n; i++) {
+            values[i] = 0.5 * i;
+        }
+        EXPECT_DOUBLE_EQ(sum_machine_reals(values.data(), n), 0.25 * n * (n - 1.)) << "n = " << n;
+    }
+}
+
+
+TEST(Vectorized, sum_machine_reals_pairwise) {
+    // adding 0.1 ten million times in sequence is off in the 9th digit.
+    const size_t n = 10000000;
+    const std::vector<machine_real_t> values(n, 0.1);
+    EXPECT_NEAR(sum_machine_reals(values.data(), n), 1e6, 1e-6);
+}
+
+
+TEST(Vectorized, sum_machine_complexes) {
+    for (size_t n : {0, 1, 2, 7, 8, 9, 1025, 5000}) {
+        std::vector<machine_complex_t> values(n);
+        for (size_t i = 0; i < n; i++) {
+            values[i] = machine_complex_t(0.5 * i, -1. * i);
+        }
+        const machine_complex_t sum = sum_machine_complexes(values.data(), n);
+        EXPECT_DOUBLE_EQ(sum.real(), 0.25 * n * (n - 1.)) << "n = " << n;
+        EXPECT_DOUBLE_EQ(sum.imag(), -0.5 * n * (n - 1.)) << "n = " << n;
+    }
+}
+
+
+TEST(Vectorized, hash_machine_integers) {
+    for (size_t n : {0, 1, 3, 4, 5, 17, 1027}) {
+        std::vector<machine_integer_t> values(n);
+        hash_t expected = 0;
+        for (size_t i = 0; i < n; i++) {
+            values[i] = machine_integer_t(i * 0x9e3779b9) - 1000;
+            expected = hash_leaf(expected, hash_machine_integer(values[i]));
+        }
+        EXPECT_EQ(hash_machine_integers(values.data(), n), expected) << "n = " << n;
+    }
+}
+
+
+TEST(Vectorized, hash_machine_reals) {
+    for (size_t n : {0, 1, 3, 4, 5, 17, 1027}) {
+        std::vector<machine_real_t> values(n);
+        hash_t expected = 0;
+        for (size_t i = 0; i < n; i++) {
+            values[i] = (i % 5 == 0) ? -0. : i * 0.25;
+            expected = hash_leaf(expected, hash_machine_real(values[i]));
+        }
+        EXPECT_EQ(hash_machine_reals(values.data(), n), expected) << "n = " << n;
+
+        // -0. and 0. are the same().
+        std::replace(values.begin(), values.end(), -0., 0.);
+        EXPECT_EQ(hash_machine_reals(values.data(), n), expected) << "n = " << n;
+    }
+}